@@ -0,0 +1,569 @@
+#define _DEFAULT_SOURCE
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#ifdef VMA_THREADS
+#include <pthread.h>
+#endif
+
+#include "vma.h"
+#define STRING_SIZE 100
+#define BENCH_ARENA_SIZE (1ULL << 34)
+#define MAX_SPAN (1 << 20)
+
+enum op_type {
+  OP_ALLOC_ARENA,
+  OP_ALLOC_BLOCK,
+  OP_FREE_BLOCK,
+  OP_WRITE,
+  OP_READ,
+  OP_PMAP,
+  OP_DEALLOC_ARENA,
+  OP_ALLOC_ANY,  // address = politica (vma_fit)
+  OP_TYPES
+};
+const char* op_names[OP_TYPES] = {"ALLOC_ARENA",   "ALLOC_BLOCK", "FREE_BLOCK",
+                                  "WRITE",         "READ",        "PMAP",
+                                  "DEALLOC_ARENA", "ALLOC_ANY"};
+typedef struct bench_op {
+  uint8_t type;
+  uint64_t address, size;
+  uint64_t payload;  // offset-ul payload-ului WRITE în trace->payload
+} bench_op;
+typedef struct trace_t {
+  bench_op* ops;
+  size_t size, capacity;
+  int8_t* payload;  // payload-urile WRITE, concatenate
+  size_t payload_size, payload_capacity;
+} trace_t;
+typedef struct op_stats {
+  uint32_t* samples;  // latențele în nanosecunde, câte una pe operație
+  size_t size, capacity;
+} op_stats;
+typedef struct result_t {
+  char scenario[STRING_SIZE];
+  double seconds;
+  size_t ops;
+  uint64_t p50[OP_TYPES], p99[OP_TYPES];
+  size_t count[OP_TYPES];
+} result_t;
+
+void* grow(void* data, size_t* capacity, size_t needed, size_t item) {
+  if (needed <= *capacity) {
+    return data;
+  }
+  size_t capacity_new = *capacity != 0 ? *capacity : 1024;
+  while (capacity_new < needed) {
+    capacity_new *= 2;
+  }
+  data = realloc(data, capacity_new * item);
+  if (data == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+  *capacity = capacity_new;
+  return data;
+}
+void add_op(trace_t* trace, uint8_t type, uint64_t address, uint64_t size) {
+  trace->ops = grow(trace->ops, &trace->capacity, trace->size + 1,
+                    sizeof(bench_op));
+  bench_op op = {type, address, size, 0};
+  trace->ops[trace->size++] = op;
+}
+void free_trace(trace_t* trace) {
+  free(trace->ops);
+  free(trace->payload);
+  memset(trace, 0, sizeof(*trace));
+}
+
+// xorshift64*, cu seed explicit ca trace-urile să fie reproductibile.
+uint64_t rng_state;
+uint64_t next_random() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+uint64_t random_below(uint64_t n) { return next_random() % n; }
+
+// Blocuri ne-adiacente la adrese crescătoare.
+void gen_sequential_fill(trace_t* trace, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    add_op(trace, OP_ALLOC_BLOCK, i * 128, 64);
+  }
+}
+// Alocări și eliberări aleatoare pe o grilă de sloturi.
+void gen_random_churn(trace_t* trace, size_t n) {
+  size_t slots = n / 2 + 1;
+  uint64_t* live = malloc(slots * sizeof(uint64_t));
+  size_t live_size = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (live_size == 0 || random_below(100) < 55) {
+      uint64_t address = random_below(slots) * 256;
+      add_op(trace, OP_ALLOC_BLOCK, address, 1 + random_below(256));
+      if (live_size < slots) {
+        live[live_size++] = address;
+      }
+    } else {
+      size_t k = random_below(live_size);
+      add_op(trace, OP_FREE_BLOCK, live[k], 0);
+      live[k] = live[--live_size];
+    }
+  }
+  free(live);
+}
+// Întâi sloturile pare, apoi cele impare: fiecare alocare impară lipește
+// două blocuri vecine.
+void gen_merge_storm(trace_t* trace, size_t n) {
+  size_t half = n / 2;
+  for (size_t i = 0; i < half; i++) {
+    add_op(trace, OP_ALLOC_BLOCK, 2 * i * 64, 64);
+  }
+  for (size_t i = 0; i < half; i++) {
+    add_op(trace, OP_ALLOC_BLOCK, (2 * i + 1) * 64, 64);
+  }
+}
+// Un singur bloc cu n/2 miniblock-uri, eliberate apoi în ordine aleatoare,
+// majoritatea din mijlocul unui bloc (split_block).
+void gen_middle_frees(trace_t* trace, size_t n) {
+  size_t half = n / 2;
+  uint64_t* order = malloc(half * sizeof(uint64_t));
+  for (size_t i = 0; i < half; i++) {
+    add_op(trace, OP_ALLOC_BLOCK, i * 32, 32);
+    order[i] = i * 32;
+  }
+  for (size_t i = half; i > 1; i--) {
+    size_t k = random_below(i);
+    uint64_t aux = order[k];
+    order[k] = order[i - 1];
+    order[i - 1] = aux;
+  }
+  for (size_t i = 0; i < half; i++) {
+    add_op(trace, OP_FREE_BLOCK, order[i], 0);
+  }
+  free(order);
+}
+// Un bloc de 256 MiB din miniblock-uri de 4 KiB, apoi READ/WRITE de până la
+// 1 MiB care traversează sute de miniblock-uri. WRITE-urile generate scriu
+// toate din același tipar, deci trace-ul nu are payload propriu.
+void gen_spanning_rw(trace_t* trace, size_t n) {
+  const uint64_t miniblocks = 1 << 16, size = 4096;
+  for (uint64_t i = 0; i < miniblocks; i++) {
+    add_op(trace, OP_ALLOC_BLOCK, i * size, size);
+  }
+  for (size_t i = 0; i < n / 64 + 1; i++) {
+    uint64_t length = 1 + random_below(MAX_SPAN);
+    uint64_t address = random_below(miniblocks * size - length);
+    if (i % 2 == 0) {
+      add_op(trace, OP_WRITE, address, length);
+    } else {
+      add_op(trace, OP_READ, address, length);
+    }
+  }
+}
+// Arena fragmentată de blocuri cu goluri de dimensiuni aleatoare, apoi
+// ALLOC_ANY cu cele trei politici pe rând.
+void gen_fragmented_any(trace_t* trace, size_t n) {
+  size_t half = n / 2;
+  uint64_t address = 0;
+  for (size_t i = 0; i < half; i++) {
+    address += 1 + random_below(4096);
+    uint64_t size = 1 + random_below(256);
+    add_op(trace, OP_ALLOC_BLOCK, address, size);
+    address += size;
+  }
+  for (size_t i = 0; i < n - half; i++) {
+    add_op(trace, OP_ALLOC_ANY, i % 3, 1 + random_below(2048));
+  }
+}
+
+typedef struct scenario_t {
+  const char* name;
+  void (*generate)(trace_t* trace, size_t n);
+} scenario_t;
+const scenario_t scenarios[] = {
+    {"sequential_fill", gen_sequential_fill},
+    {"random_churn", gen_random_churn},
+    {"merge_storm", gen_merge_storm},
+    {"middle_frees", gen_middle_frees},
+    {"spanning_rw", gen_spanning_rw},
+    {"fragmented_any", gen_fragmented_any},
+};
+const size_t no_scenarios = sizeof(scenarios) / sizeof(scenarios[0]);
+
+// Citește un fișier de comenzi în formatul textului din tema1. Payload-ul
+// unui WRITE începe după spațiul de după size și poate conține '\n'.
+int load_trace(const char* path, trace_t* trace) {
+  FILE* in = fopen(path, "rb");
+  if (in == NULL) {
+    perror(path);
+    return 0;
+  }
+  char line[STRING_SIZE];
+  while (fgets(line, sizeof(line), in) != NULL) {
+    char* rest = line;
+    char* name = strsep(&rest, " \n");
+    if (strcmp(name, "ALLOC_ARENA") == 0) {
+      add_op(trace, OP_ALLOC_ARENA, 0, strtoull(rest, NULL, 10));
+    } else if (strcmp(name, "ALLOC_BLOCK") == 0) {
+      uint64_t address = strtoull(rest, &rest, 10);
+      add_op(trace, OP_ALLOC_BLOCK, address, strtoull(rest, NULL, 10));
+    } else if (strcmp(name, "ALLOC_ANY") == 0) {
+      uint64_t size = strtoull(rest, &rest, 10);
+      vma_fit policy = VMA_FIT_FIRST;
+      if (strncmp(rest, " BEST", 5) == 0) {
+        policy = VMA_FIT_BEST;
+      } else if (strncmp(rest, " NEXT", 5) == 0) {
+        policy = VMA_FIT_NEXT;
+      }
+      add_op(trace, OP_ALLOC_ANY, policy, size);
+    } else if (strcmp(name, "FREE_BLOCK") == 0) {
+      add_op(trace, OP_FREE_BLOCK, strtoull(rest, NULL, 10), 0);
+    } else if (strcmp(name, "READ") == 0) {
+      uint64_t address = strtoull(rest, &rest, 10);
+      add_op(trace, OP_READ, address, strtoull(rest, NULL, 10));
+    } else if (strcmp(name, "PMAP") == 0) {
+      add_op(trace, OP_PMAP, 0, 0);
+    } else if (strcmp(name, "DEALLOC_ARENA") == 0) {
+      add_op(trace, OP_DEALLOC_ARENA, 0, 0);
+    } else if (strcmp(name, "WRITE") == 0 && rest != NULL) {
+      uint64_t address = strtoull(rest, &rest, 10);
+      uint64_t size = strtoull(rest, &rest, 10);
+      rest += *rest == ' ';
+      size_t buffered = strlen(rest);
+      trace->payload =
+          grow(trace->payload, &trace->payload_capacity,
+               trace->payload_size + size + buffered, sizeof(int8_t));
+      int8_t* dst = trace->payload + trace->payload_size;
+      size_t count = buffered < size ? buffered : size;
+      memcpy(dst, rest, count);
+      if (count < size) {
+        count += fread(dst + count, 1, size - count, in);
+      }
+      add_op(trace, OP_WRITE, address, size);
+      trace->ops[trace->size - 1].payload = trace->payload_size;
+      trace->payload_size += size;
+      int last = count > 0 ? (uint8_t)dst[count - 1] : EOF;
+      if (buffered > size) {
+        last = (uint8_t)rest[buffered - 1];
+      }
+      while (last != '\n' && last != EOF) {
+        last = getc(in);
+      }
+    }
+  }
+  fclose(in);
+  return 1;
+}
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+void record_sample(op_stats* stats, uint64_t ns) {
+  stats->samples = grow(stats->samples, &stats->capacity, stats->size + 1,
+                        sizeof(uint32_t));
+  stats->samples[stats->size++] = ns > UINT32_MAX ? UINT32_MAX : ns;
+}
+int compare_samples(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+// Echivalentul traversării din PMAP, fără formatare.
+uint64_t walk_arena(const arena_t* arena) {
+  uint64_t sum = 0;
+  for (block_t* curr = arena->alloc_list->head; curr != NULL;
+       curr = curr->next) {
+    miniblock_t* currm = curr->miniblocks.head;
+    for (; currm != NULL; currm = currm->next) {
+      sum += currm->start_address + currm->size;
+    }
+  }
+  return sum;
+}
+
+int8_t pattern[MAX_SPAN];
+
+// Execută operațiile trace-ului pe arenă și adaugă latențele în stats.
+// Întoarce arena curentă, care se schimbă la ALLOC_ARENA/DEALLOC_ARENA.
+arena_t* execute(arena_t* arena, const trace_t* trace, op_stats* stats) {
+  int8_t* buffer = malloc(MAX_SPAN);
+  volatile uint64_t sink = 0;
+  for (size_t i = 0; i < trace->size; i++) {
+    const bench_op* op = &trace->ops[i];
+    uint64_t size = op->size;
+    uint64_t start = now_ns();
+    switch (op->type) {
+      case OP_ALLOC_ARENA:
+        if (arena != NULL) {
+          dealloc_arena(arena);
+        }
+        arena = alloc_arena(op->size);
+        break;
+      case OP_ALLOC_BLOCK:
+        alloc_block(arena, op->address, op->size);
+        break;
+      case OP_ALLOC_ANY: {
+        uint64_t address;
+        alloc_any(arena, op->size, op->address, &address);
+        break;
+      }
+      case OP_FREE_BLOCK:
+        free_block(arena, op->address);
+        break;
+      case OP_WRITE:
+        if (trace->payload != NULL) {
+          vma_write(arena, op->address, &size, trace->payload + op->payload);
+        } else {
+          vma_write(arena, op->address, &size, pattern);
+        }
+        break;
+      case OP_READ:
+        if (size > MAX_SPAN) {
+          size = MAX_SPAN;
+        }
+        vma_read(arena, op->address, &size, buffer);
+        sink += buffer[0];
+        break;
+      case OP_PMAP:
+        sink += walk_arena(arena);
+        break;
+      case OP_DEALLOC_ARENA:
+        dealloc_arena(arena);
+        arena = NULL;
+        break;
+    }
+    record_sample(&stats[op->type], now_ns() - start);
+    if (arena == NULL && i + 1 < trace->size &&
+        trace->ops[i + 1].type != OP_ALLOC_ARENA) {
+      break;
+    }
+  }
+  free(buffer);
+  return arena;
+}
+void summarize(op_stats* stats, const char* name, size_t ops, double seconds,
+               result_t* result) {
+  memset(result, 0, sizeof(*result));
+  snprintf(result->scenario, sizeof(result->scenario), "%s", name);
+  result->seconds = seconds;
+  result->ops = ops;
+  for (int t = 0; t < OP_TYPES; t++) {
+    if (stats[t].size == 0) {
+      continue;
+    }
+    qsort(stats[t].samples, stats[t].size, sizeof(uint32_t), compare_samples);
+    result->count[t] = stats[t].size;
+    result->p50[t] = stats[t].samples[stats[t].size / 2];
+    result->p99[t] = stats[t].samples[stats[t].size * 99 / 100];
+    free(stats[t].samples);
+  }
+}
+// Rulează trace-ul pe o arenă nouă (sau pe cea creată de ALLOC_ARENA din
+// trace) și măsoară fiecare operație.
+void run_trace(const trace_t* trace, const char* name, result_t* result) {
+  op_stats stats[OP_TYPES];
+  memset(stats, 0, sizeof(stats));
+  arena_t* arena = alloc_arena(BENCH_ARENA_SIZE);
+  uint64_t begin = now_ns();
+  arena = execute(arena, trace, stats);
+  uint64_t end = now_ns();
+  if (arena != NULL) {
+    dealloc_arena(arena);
+  }
+  summarize(stats, name, trace->size, (end - begin) / 1e9, result);
+}
+
+#ifdef VMA_THREADS
+typedef struct worker_t {
+  pthread_t thread;
+  arena_t* arena;
+  trace_t trace;
+  op_stats stats[OP_TYPES];
+} worker_t;
+void* run_worker(void* arg) {
+  worker_t* worker = arg;
+  execute(worker->arena, &worker->trace, worker->stats);
+  return NULL;
+}
+// Fiecare thread rulează scenariul în propria regiune a aceleiași arene, deci
+// pe zone disjuncte; latențele tuturor sunt raportate împreună.
+void run_threaded(const scenario_t* scenario, size_t ops, uint64_t seed,
+                  unsigned int threads, result_t* result) {
+  worker_t* workers = calloc(threads, sizeof(worker_t));
+  arena_t* arena = alloc_arena(BENCH_ARENA_SIZE);
+  uint64_t region = BENCH_ARENA_SIZE / threads;
+  size_t total = 0;
+  for (unsigned int t = 0; t < threads; t++) {
+    rng_state = (seed + t) * 2 + 1;
+    scenario->generate(&workers[t].trace, ops / threads);
+    for (size_t i = 0; i < workers[t].trace.size; i++) {
+      workers[t].trace.ops[i].address += t * region;
+    }
+    workers[t].arena = arena;
+    total += workers[t].trace.size;
+  }
+  uint64_t begin = now_ns();
+  for (unsigned int t = 0; t < threads; t++) {
+    pthread_create(&workers[t].thread, NULL, run_worker, &workers[t]);
+  }
+  for (unsigned int t = 0; t < threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+  }
+  uint64_t end = now_ns();
+  op_stats stats[OP_TYPES];
+  memset(stats, 0, sizeof(stats));
+  for (unsigned int t = 0; t < threads; t++) {
+    for (int k = 0; k < OP_TYPES; k++) {
+      for (size_t i = 0; i < workers[t].stats[k].size; i++) {
+        record_sample(&stats[k], workers[t].stats[k].samples[i]);
+      }
+      free(workers[t].stats[k].samples);
+    }
+    free_trace(&workers[t].trace);
+  }
+  dealloc_arena(arena);
+  free(workers);
+  char name[STRING_SIZE];
+  snprintf(name, sizeof(name), "%s/%ut", scenario->name, threads);
+  summarize(stats, name, total, (end - begin) / 1e9, result);
+}
+#endif
+
+// Rezultatele salvate cu --save: câte o linie "scenariu ops/s".
+double baseline_rate(const char* path, const char* scenario) {
+  FILE* in = path != NULL ? fopen(path, "r") : NULL;
+  if (in == NULL) {
+    return 0;
+  }
+  char name[STRING_SIZE];
+  double rate, found = 0;
+  while (fscanf(in, "%99s %lf", name, &rate) == 2) {
+    if (strcmp(name, scenario) == 0) {
+      found = rate;
+    }
+  }
+  fclose(in);
+  return found;
+}
+void report(const result_t* result, const char* baseline, FILE* save) {
+  double rate = result->ops / (result->seconds > 0 ? result->seconds : 1e-9);
+  printf("%s: %zu ops in %.3f s, %.0f ops/s", result->scenario, result->ops,
+         result->seconds, rate);
+  double base = baseline_rate(baseline, result->scenario);
+  if (base > 0) {
+    printf(" (%+.1f%% vs baseline)", (rate / base - 1) * 100);
+  }
+  printf("\n");
+  for (int t = 0; t < OP_TYPES; t++) {
+    if (result->count[t] != 0) {
+      printf("  %-13s n=%-9zu p50=%" PRIu64 "ns p99=%" PRIu64 "ns\n",
+             op_names[t], result->count[t], result->p50[t], result->p99[t]);
+    }
+  }
+  if (save != NULL) {
+    fprintf(save, "%s %.0f\n", result->scenario, rate);
+  }
+}
+void usage(const char* argv0) {
+  fprintf(stderr,
+          "usage: %s [--scenario NAME|all] [--ops N] [--seed S]\n"
+          "          [--threads N] [--replay FILE] [--save FILE]\n"
+          "          [--baseline FILE]\n"
+          "scenarios:",
+          argv0);
+  for (size_t i = 0; i < no_scenarios; i++) {
+    fprintf(stderr, " %s", scenarios[i].name);
+  }
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[]) {
+  const char *scenario = "all", *replay = NULL, *save_path = NULL,
+             *baseline = NULL;
+  size_t ops = 200000;
+  uint64_t seed = 42;
+  unsigned int threads = 1;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "--scenario") == 0) {
+      scenario = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--ops") == 0) {
+      ops = strtoull(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--threads") == 0) {
+      threads = strtoul(argv[++i], NULL, 10);
+    } else if (i + 1 < argc && strcmp(argv[i], "--replay") == 0) {
+      replay = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--save") == 0) {
+      save_path = argv[++i];
+    } else if (i + 1 < argc && strcmp(argv[i], "--baseline") == 0) {
+      baseline = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+#ifndef VMA_THREADS
+  if (threads != 1) {
+    fprintf(stderr, "--threads needs a build with THREADS=1\n");
+    return 1;
+  }
+#endif
+  if (threads == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  for (size_t i = 0; i < sizeof(pattern); i++) {
+    pattern[i] = 'a' + i % 26;
+  }
+  FILE* save = save_path != NULL ? fopen(save_path, "w") : NULL;
+  result_t result;
+  trace_t trace;
+  memset(&trace, 0, sizeof(trace));
+  if (replay != NULL) {
+    if (!load_trace(replay, &trace)) {
+      return 1;
+    }
+    run_trace(&trace, replay, &result);
+    report(&result, baseline, save);
+    free_trace(&trace);
+  } else {
+    int found = 0;
+    for (size_t i = 0; i < no_scenarios; i++) {
+      if (strcmp(scenario, "all") != 0 &&
+          strcmp(scenario, scenarios[i].name) != 0) {
+        continue;
+      }
+      found = 1;
+#ifdef VMA_THREADS
+      if (threads > 1) {
+        run_threaded(&scenarios[i], ops, seed, threads, &result);
+        report(&result, baseline, save);
+        continue;
+      }
+#endif
+      rng_state = seed * 2 + 1;
+      scenarios[i].generate(&trace, ops);
+      run_trace(&trace, scenarios[i].name, &result);
+      report(&result, baseline, save);
+      free_trace(&trace);
+    }
+    if (!found) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  struct rusage usage_info;
+  getrusage(RUSAGE_SELF, &usage_info);
+  printf("peak RSS: %ld KiB\n", usage_info.ru_maxrss);
+  if (save != NULL) {
+    fclose(save);
+  }
+  return 0;
+}
@@ -0,0 +1,346 @@
+#define _DEFAULT_SOURCE
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Urme binare aleatoare pentru make check (check.sh) și grupurile unui
+// jurnal. Înregistrările au formatul modului binar din tema1.c.
+#define NAMES 12
+#define NAME_SIZE 24
+#define BLOCKS 64
+#define PATH_SIZE 4096        // căile de atâția octeți sunt respinse de tema1
+#define BATCH_SIZE (1 << 20)  // pattern-urile FIND mai lungi sunt respinse
+#define SAVES 4
+
+enum command_opcode {
+  OP_ALLOC_ARENA = 1,
+  OP_ALLOC_BLOCK,
+  OP_FREE_BLOCK,
+  OP_WRITE,
+  OP_READ,
+  OP_PMAP,
+  OP_DEALLOC_ARENA,
+  OP_STATS,
+  OP_ALLOC_ANY,
+  OP_MPROTECT,
+  OP_READV,
+  OP_WRITEV,
+  OP_COMPACT,
+  OP_SAVE,
+  OP_LOAD,
+  OP_CLONE_ARENA,
+  OP_USE,
+  OP_MEMSET,
+  OP_MEMMOVE,
+  OP_FIND,
+  OP_COMMIT,
+  OP_COMPRESS
+};
+typedef struct command_record {
+  uint8_t opcode;
+  uint8_t reserved[7];
+  uint64_t address;
+  uint64_t size;
+} command_record;
+// Ce știe generatorul despre un nume: doar cât să aleagă adrese plauzibile.
+// Dacă arena mai există nu contează, tema1 răspunde oricum determinist.
+typedef struct name_t {
+  char name[NAME_SIZE];
+  uint64_t size;  // dimensiunea ultimei arene alocate, 0 dacă niciuna
+  uint64_t blocks[BLOCKS];
+  size_t count;
+  FILE* sub;  // comenzile date numelui, precedate de USE <nume>
+} name_t;
+// Comanda în curs de generare: înregistrarea și ce urmează după ea.
+typedef struct command_t {
+  char* data;
+  size_t size, capacity;
+} command_t;
+
+name_t names[NAMES];
+size_t no_names, current;
+size_t order[NAMES], no_order;  // numele, în ordinea primului USE
+command_t command;
+
+// xorshift64*, ca în bench.c.
+uint64_t rng_state;
+uint64_t next_random() {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+uint64_t random_below(uint64_t n) { return next_random() % n; }
+
+void put(const void* data, size_t size) {
+  if (command.size + size > command.capacity) {
+    size_t capacity = command.capacity != 0 ? command.capacity : 4096;
+    while (capacity < command.size + size) {
+      capacity *= 2;
+    }
+    command.data = realloc(command.data, capacity);
+    if (command.data == NULL) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+    command.capacity = capacity;
+  }
+  memcpy(command.data + command.size, data, size);
+  command.size += size;
+}
+void put_record(uint8_t opcode, uint64_t address, uint64_t size) {
+  command_record record = {opcode, {0}, address, size};
+  put(&record, sizeof(record));
+}
+void put_operand(uint64_t value) { put(&value, sizeof(value)); }
+// n octeți aleși din alphabet.
+void put_bytes(const char* alphabet, uint64_t n) {
+  size_t letters = strlen(alphabet);
+  for (uint64_t i = 0; i < n; i++) {
+    put(&alphabet[random_below(letters)], 1);
+  }
+}
+// Un payload care se comprimă bine: aceeași literă de n ori.
+void put_run(uint64_t n) {
+  char letter = 'a' + random_below(26);
+  for (uint64_t i = 0; i < n; i++) {
+    put(&letter, 1);
+  }
+}
+void put_use(const name_t* name) {
+  put_record(OP_USE, 0, strlen(name->name));
+  put(name->name, strlen(name->name));
+}
+// O adresă din arena numelui, de obicei lângă un bloc alocat.
+uint64_t pick_address(const name_t* name) {
+  uint64_t size = name->size != 0 ? name->size : 65536;
+  if (name->count == 0) {
+    return random_below(size);
+  }
+  return name->blocks[random_below(name->count)] + random_below(3000);
+}
+// O cale de SAVE/LOAD din dir, una din cele SAVES.
+void put_path(uint8_t opcode, const char* dir) {
+  char path[PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/save.%d", dir, (int)random_below(SAVES));
+  put_record(opcode, 0, strlen(path));
+  put(path, strlen(path));
+}
+// O comandă pentru numele curent; 1 dacă a fost un USE care schimbă numele.
+// Cu linked, urma leagă numele între ele prin COMPACT AUTO, SAVE și LOAD.
+int gen_command(const char* dir, int linked) {
+  name_t* name = &names[current];
+  uint64_t c = random_below(1000);
+  if (c < 50) {
+    current = random_below(no_names);
+    put_use(&names[current]);
+    size_t i = 0;
+    while (i < no_order && order[i] != current) {
+      i++;
+    }
+    if (i == no_order) {
+      order[no_order++] = current;
+    }
+    return 1;
+  } else if (c < 80 || name->size == 0) {
+    static const uint64_t sizes[] = {65536, 300000, 1 << 20};
+    name->size = sizes[random_below(3)];
+    name->count = 0;
+    put_record(OP_ALLOC_ARENA, name->size, 0);
+  } else if (c < 100) {
+    put_record(OP_CLONE_ARENA, 0, 0);
+  } else if (c < 120) {
+    put_record(OP_DEALLOC_ARENA, 0, 0);
+  } else if (c < 250) {
+    uint64_t address = random_below(name->size - 100);
+    if (name->count < BLOCKS) {
+      name->blocks[name->count++] = address;
+    }
+    put_record(OP_ALLOC_BLOCK, address, 1 + random_below(20000));
+  } else if (c < 330 && name->count != 0) {
+    put_record(OP_FREE_BLOCK, name->blocks[random_below(name->count)], 0);
+  } else if (c < 480) {
+    uint64_t size = 1 + random_below(5000);
+    put_record(OP_WRITE, pick_address(name), size);
+    if (random_below(2)) {
+      put_run(size);
+    } else {
+      put_bytes("abcxyz", size);
+    }
+  } else if (c < 530) {
+    uint64_t k = random_below(4), total = 0;
+    put_record(OP_WRITEV, 0, k);
+    for (uint64_t i = 0; i < k; i++) {
+      uint64_t size = 1 + random_below(2000);
+      put_operand(pick_address(name));
+      put_operand(size);
+      total += size;
+    }
+    put_bytes("abc", total);
+  } else if (c < 560) {
+    uint64_t k = random_below(4);
+    put_record(OP_READV, 0, k);
+    for (uint64_t i = 0; i < k; i++) {
+      put_operand(pick_address(name));
+      put_operand(1 + random_below(500));
+    }
+  } else if (c < 590) {
+    put_record(OP_MEMSET, pick_address(name), 1 + random_below(3000));
+    put_operand('a' + random_below(3));
+  } else if (c < 620) {
+    put_record(OP_MEMMOVE, pick_address(name), 1 + random_below(3000));
+    put_operand(pick_address(name));
+  } else if (c < 650) {
+    uint64_t length = 1 + random_below(3);
+    put_record(OP_FIND, pick_address(name), 1 + random_below(5000));
+    put_operand(length);
+    put_bytes("abc", length);
+  } else if (c < 660) {
+    put_record(OP_COMPACT, 0, 0);
+  } else if (c < 690) {
+    put_record(OP_ALLOC_ANY, random_below(3), 1 + random_below(30000));
+  } else if (c < 710) {
+    put_record(OP_PMAP, 0, 0);
+  } else if (c < 720) {
+    static const uint64_t idle[] = {0, 1, 3, 50};
+    put_record(OP_COMPRESS, idle[random_below(4)], 0);
+  } else if (c < 740 && name->count != 0) {
+    static const uint64_t perms[] = {4, 0, 6};
+    put_record(OP_MPROTECT, name->blocks[random_below(name->count)],
+               perms[random_below(3)]);
+  } else if (c < 750) {
+    // O cale prea lungă, consumată și respinsă fără să strice încadrarea.
+    static const uint8_t opcodes[] = {OP_SAVE, OP_LOAD, OP_USE};
+    uint64_t size = PATH_SIZE + random_below(1000);
+    put_record(opcodes[random_below(3)], 0, size);
+    put_run(size);
+  } else if (c < 755) {
+    put_record(OP_USE, 0, 40);
+    put_run(40);
+  } else if (c < 760) {
+    put_record(OP_COMMIT, 0, 0);
+  } else if (c < 762) {
+    put_record(OP_FIND, 0, 10);
+    put_operand(BATCH_SIZE + 5);
+    put_run(BATCH_SIZE + 5);
+  } else if (linked && c < 772) {
+    static const uint64_t thresholds[] = {0, 10, 30, 60};
+    put_record(OP_COMPACT, 1, thresholds[random_below(4)]);
+  } else if (linked && c < 782) {
+    put_path(OP_SAVE, dir);
+  } else if (linked && c < 792) {
+    put_path(OP_LOAD, dir);
+  } else {
+    put_record(OP_READ, pick_address(name), 1 + random_below(3000));
+  }
+  return 0;
+}
+FILE* open_file(const char* dir, const char* file) {
+  char path[PATH_SIZE];
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  return f;
+}
+// Scrie în dir: trace.bin cu ops comenzi, half.bin cu prima jumătate,
+// probe.bin, care arată starea fiecărui nume: PMAP și un SAVE în
+// dir/snap.<nume>, sub.<nume> cu comenzile fiecărui nume și names cu
+// numele în ordinea în care apar.
+void gen_trace(uint64_t seed, size_t ops, const char* dir, int linked) {
+  FILE* trace = open_file(dir, "trace.bin");
+  FILE* half = open_file(dir, "half.bin");
+  FILE* probe = open_file(dir, "probe.bin");
+  rng_state = seed * 2 + 1;
+  no_names = 2 + random_below(NAMES - 1);
+  for (size_t i = 0; i < no_names; i++) {
+    if (i == 0) {
+      strcpy(names[i].name, "0");
+    } else {
+      snprintf(names[i].name, NAME_SIZE, "a%zu", i - 1);
+    }
+    char file[NAME_SIZE + 4] = "sub.";
+    strcat(file, names[i].name);
+    names[i].sub = open_file(dir, file);
+    command.size = 0;
+    put_use(&names[i]);
+    fwrite(command.data, 1, command.size, names[i].sub);
+  }
+  order[no_order++] = 0;
+  for (size_t i = 0; i < ops; i++) {
+    size_t owner = current;
+    command.size = 0;
+    if (!gen_command(dir, linked)) {
+      fwrite(command.data, 1, command.size, names[owner].sub);
+    }
+    fwrite(command.data, 1, command.size, trace);
+    if (i < ops / 2) {
+      fwrite(command.data, 1, command.size, half);
+    }
+  }
+  FILE* list = open_file(dir, "names");
+  for (size_t i = 0; i < no_order; i++) {
+    fprintf(list, "%s\n", names[order[i]].name);
+  }
+  fclose(list);
+  command.size = 0;
+  for (size_t i = 0; i < no_names; i++) {
+    put_use(&names[i]);
+    put_record(OP_PMAP, 0, 0);
+    char path[PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/snap.%s", dir, names[i].name);
+    put_record(OP_SAVE, 0, strlen(path));
+    put(path, strlen(path));
+  }
+  fwrite(command.data, 1, command.size, probe);
+  fclose(trace);
+  fclose(half);
+  fclose(probe);
+  for (size_t i = 0; i < no_names; i++) {
+    fclose(names[i].sub);
+  }
+  free(command.data);
+}
+// Sfârșitul fiecărui grup din jurnal, pornind de la 0. Sumele de control
+// nu sunt verificate: jurnalul citit e cel scris întreg de tema1.
+int print_groups(const char* path) {
+  FILE* f = fopen(path, "rb");
+  command_record header;
+  uint64_t end = 0;
+  if (f == NULL) {
+    perror(path);
+    return 0;
+  }
+  printf("0\n");
+  while (fread(&header, sizeof(header), 1, f) == 1 &&
+         header.opcode == OP_COMMIT) {
+    end += sizeof(header) + header.size;
+    printf("%" PRIu64 "\n", end);
+    if (fseek(f, end, SEEK_SET) != 0) {
+      break;
+    }
+  }
+  fclose(f);
+  return 1;
+}
+
+int main(int argc, char* argv[]) {
+  if ((argc == 5 || (argc == 6 && strcmp(argv[5], "linked") == 0)) &&
+      strcmp(argv[1], "trace") == 0) {
+    gen_trace(strtoull(argv[2], NULL, 10), strtoull(argv[3], NULL, 10),
+              argv[4], argc == 6);
+    return 0;
+  }
+  if (argc == 3 && strcmp(argv[1], "groups") == 0) {
+    return print_groups(argv[2]) ? 0 : 1;
+  }
+  fprintf(stderr,
+          "usage: %s trace SEED OPS DIR [linked]\n"
+          "       %s groups JOURNAL\n",
+          argv[0], argv[0]);
+  return 1;
+}
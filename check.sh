@@ -0,0 +1,144 @@
+#!/bin/bash
+# Verificările din make check, pe urme aleatoare generate de check_vma.
+# usage: ./check.sh [seed...]
+#
+# Jurnalul: după o rulare întreagă, după tăieri la poziții aleatoare, după
+# un octet inversat și după un SIGKILL, starea refăcută din jurnal trebuie
+# să fie cea a grupurilor întregi din fața stricăciunii.
+#
+# Reluarea cu --parallel: ieșirea fiecărui nume trebuie să fie cea a
+# comenzilor lui rulate separat, iar liniile, aceleași ca la rularea
+# secvențială, oricâte fire ar fi. O urmă care leagă numele între ele
+# (COMPACT AUTO, SAVE și LOAD) e verificată doar față de cea secvențială.
+set -u
+export LC_ALL=C
+TEMA=${TEMA:-./tema1}
+GEN=${GEN:-./check_vma}
+OPS=${OPS:-3000}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+fail() {
+  echo "FAIL seed $seed: $*"
+  failed=1
+}
+# Ieșirea lui probe.bin, urmată de snapshot-urile pe care le-a salvat.
+snapshots() {
+  cat "$dir"/snap.* 2> /dev/null
+  rm -f "$dir"/snap.*
+}
+# Starea numelor după urma $1, văzută prin probe.bin.
+state() {
+  "$TEMA" --binary < "$1" > "$dir/before"
+  cat "$1" "$dir/probe.bin" | "$TEMA" --binary |
+    tail -c +$(($(stat -c %s "$dir/before") + 1))
+  snapshots
+}
+# Pornește din jurnalul $1 și arată starea refăcută.
+recover() {
+  "$TEMA" --binary --journal "$1" < /dev/null > /dev/null || return 1
+  cp "$1" "$dir/probe.journal"
+  "$TEMA" --binary --journal "$dir/probe.journal" < "$dir/probe.bin"
+  snapshots
+}
+# Ultimul sfârșit de grup din jurnalul întreg, cel mult $1.
+group_before() {
+  awk -v at="$1" '$1 <= at { last = $1 } END { print last }' "$dir/groups"
+}
+# Jurnalul stricat $1 trebuie să se refacă exact ca primii $2 octeți din
+# cel întreg: același fișier după pornire și aceeași stare.
+check_prefix() {
+  local name=$1 valid=$2
+  head -c "$valid" "$dir/journal" > "$dir/prefix"
+  if ! recover "$dir/prefix" > "$dir/expect" ||
+    ! recover "$dir/$name" > "$dir/got"; then
+    fail "$name: restart failed"
+    return
+  fi
+  cmp -s "$dir/prefix" "$dir/$name" ||
+    fail "$name: journal not cut back to $valid bytes"
+  cmp -s "$dir/expect" "$dir/got" || fail "$name: state differs"
+  state "$dir/prefix" | cmp -s - "$dir/got" || fail "$name: replay differs"
+}
+
+# Rulează urma $1 cu --parallel $2, după ce șterge salvările rulării
+# de dinainte, ca un LOAD să găsească doar ce a salvat urma însăși.
+parallel() {
+  rm -f "$dir"/save.*
+  "$TEMA" --binary --parallel "$2" < "$1"
+}
+serial() {
+  rm -f "$dir"/save.*
+  "$TEMA" --binary < "$1" | sort
+}
+
+[ $# -gt 0 ] || set -- 1 2 3 4 5 6 7 8
+for seed in "$@"; do
+  RANDOM=$seed
+  "$GEN" trace "$seed" "$OPS" "$dir" || exit 1
+  state "$dir/trace.bin" > "$dir/expect"
+
+  # Rulare întreagă, cu grupuri mici ca jurnalul să aibă multe.
+  rm -f "$dir/journal"
+  "$TEMA" --binary --journal "$dir/journal" --group-commit 64 1000000 \
+    < "$dir/trace.bin" > /dev/null
+  "$GEN" groups "$dir/journal" > "$dir/groups"
+  size=$(stat -c %s "$dir/journal")
+  [ "$(group_before "$size")" = "$size" ] || fail "journal ends mid-group"
+  cp "$dir/journal" "$dir/whole"
+  recover "$dir/whole" | cmp -s - "$dir/expect" || fail "whole: state differs"
+
+  for i in 1 2 3 4 5; do
+    at=$(((RANDOM * 32768 + RANDOM) % size))
+    head -c "$at" "$dir/journal" > "$dir/cut"
+    check_prefix cut "$(group_before "$at")"
+
+    at=$(((RANDOM * 32768 + RANDOM) % size))
+    cp "$dir/journal" "$dir/flip"
+    byte=$(od -An -tu1 -j "$at" -N1 "$dir/journal")
+    printf "\\$(printf %o $((byte ^ 1 << RANDOM % 8)))" |
+      dd of="$dir/flip" bs=1 seek="$at" conv=notrunc status=none
+    check_prefix flip "$(group_before "$at")"
+  done
+
+  # SIGKILL cu intrarea încă deschisă: comenzile primite trebuie să fi
+  # ajuns pe disc cât tema1 aștepta restul.
+  rm -f "$dir/kill" "$dir/fifo"
+  mkfifo "$dir/fifo"
+  "$TEMA" --binary --journal "$dir/kill" < "$dir/fifo" > /dev/null &
+  pid=$!
+  exec 3> "$dir/fifo"
+  cat "$dir/half.bin" >&3
+  sleep 1
+  kill -9 "$pid"
+  wait "$pid" 2> /dev/null
+  exec 3>&-
+  state "$dir/half.bin" > "$dir/expect"
+  recover "$dir/kill" | cmp -s - "$dir/expect" || fail "kill: state differs"
+
+  # Urma are DEALLOC_ARENA, comenzi pentru arene moarte și căi prea lungi.
+  : > "$dir/expect"
+  while read -r name; do
+    "$TEMA" --binary < "$dir/sub.$name" >> "$dir/expect"
+  done < "$dir/names"
+  serial "$dir/trace.bin" > "$dir/serial"
+  for threads in 1 2 8 0; do
+    parallel "$dir/trace.bin" "$threads" > "$dir/got" ||
+      fail "parallel $threads: exit status"
+    cmp -s "$dir/expect" "$dir/got" ||
+      fail "parallel $threads: differs from the per-name runs"
+    sort "$dir/got" | cmp -s - "$dir/serial" ||
+      fail "parallel $threads: differs from the serial run"
+  done
+
+  "$GEN" trace "$seed" "$OPS" "$dir" linked || exit 1
+  serial "$dir/trace.bin" > "$dir/serial"
+  for threads in 1 8; do
+    parallel "$dir/trace.bin" "$threads" | sort |
+      cmp -s - "$dir/serial" || fail "linked $threads: differs from serial"
+  done
+done
+
+[ "$failed" = 0 ] && echo "check: all passed"
+exit "$failed"
@@ -1,611 +1,1930 @@
-
+#define _DEFAULT_SOURCE
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "vma.h"
+#ifdef VMA_THREADS
+#include <pthread.h>
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL
+#endif
 #define STRING_SIZE 100
-typedef struct miniblock_t {
-  uint64_t start_address;  // adresa de început a zonei, un indice din arenă
-  size_t size;             // size-ul miniblock-ului
-  uint8_t perm;            // permisiunile asociate zonei, by default RW-
-  void* rw_buffer;  // buffer-ul de date, folosit pentru opearțiile de read() și
-                    // write()
-  struct miniblock_t *next, *prev;
-} miniblock_t;
-typedef struct miniblock_list {
-  miniblock_t* head;
-  miniblock_t* last;
-  unsigned int data_size;
-  unsigned int size;
-} miniblock_list;
-typedef struct block_t {
-  uint64_t start_address;  // adresa de început a zonei, un indice din arenă
-  size_t size;  // dimensiunea totală a zonei, suma size-urilor miniblock-urilor
-  void* miniblock_list;  // lista de miniblock-uri adiacente
-  struct block_t *next, *prev;
-} block_t;
-typedef struct {
-  block_t* head;
-  block_t* last;
-  unsigned int data_size;
-  unsigned int size;
-} list_t;
+#define OUT_BUFFER_SIZE (1 << 16)
+#define BATCH_SIZE (1 << 20)
+#define PATH_SIZE 4096
+#define NAME_SIZE 32
+#define DEFAULT_ARENA "0"
+#define JOURNAL_BUFFER (1 << 16)
+#define JOURNAL_INLINE 512  // payload-urile mai lungi nu sunt copiate
+#define JOURNAL_GROUP_OPS 4096
+#define JOURNAL_GROUP_US 10000
+// Modul binar (--binary): un șir de înregistrări de lungime fixă, în
+// ordinea nativă a octeților. Pentru WRITE, cei size octeți de payload urmează
+// imediat după înregistrare.
+enum command_opcode {
+  OP_ALLOC_ARENA = 1,  // address = dimensiunea arenei
+  OP_ALLOC_BLOCK,      // address, size
+  OP_FREE_BLOCK,       // address
+  OP_WRITE,            // address, size, urmat de payload
+  OP_READ,             // address, size
+  OP_PMAP,
+  OP_DEALLOC_ARENA,
+  OP_STATS,
+  OP_ALLOC_ANY,  // address = politica (vma_fit), size
+  OP_MPROTECT,   // address, size = permisiunile (VMA_PROT_*)
+  OP_READV,      // size = numărul de segmente, urmat de perechile
+                 // (address, size) ale acestora
+  OP_WRITEV,     // ca OP_READV, urmat de payload-urile alipite
+  OP_COMPACT,    // address = 0: compactează acum; 1: pragul automat = size
+  OP_SAVE,       // size = lungimea căii, urmată de cale
+  OP_LOAD,       // ca OP_SAVE
+  OP_CLONE_ARENA,
+  OP_USE,      // size = lungimea numelui arenei, urmată de nume
+  OP_MEMSET,   // address, size, urmat de un uint64_t cu valoarea octetului
+  OP_MEMMOVE,  // address = destinația, size, urmat de un uint64_t cu sursa
+  OP_FIND,     // address, size, urmat de un uint64_t cu lungimea
+               // pattern-ului și de pattern
+  OP_COMMIT,   // începutul unui grup din jurnal: address = suma de control,
+               // size = lungimea grupului; la execuție nu face nimic
+  OP_COMPRESS  // address = operațiile după care o pagină neaccesată e
+               // comprimată; 0 oprește compresia
+};
+typedef struct command_record {
+  uint8_t opcode;
+  uint8_t reserved[7];
+  uint64_t address;
+  uint64_t size;
+} command_record;
+typedef struct batch_reader {
+  FILE* in;
+  char* data;  // fereastra citită din stream, de cel mult BATCH_SIZE octeți
+  size_t pos, len;
+} batch_reader;
+typedef struct out_buf {
+  char* data;
+  size_t size, capacity;
+} out_buf;
+// Payload-ul unui WRITE: întâi octeții deja citiți odată cu comanda (prefix),
+// apoi restul direct din stream.
+typedef struct payload_source {
+  const char* prefix;
+  uint64_t prefix_size;
+  FILE* in;
+  int last;      // ultimul octet consumat, sau EOF
+  out_buf* tee;  // dacă nu e NULL, primește o copie a octeților consumați
+} payload_source;
+// Compactarea automată (COMPACT AUTO <procent>): după un FREE_BLOCK care
+// duce fragmentarea peste prag și când un ALLOC_ANY nu găsește loc deși
+// memoria liberă ar ajunge. 0 o oprește.
+THREAD_LOCAL unsigned int compact_threshold = 0;
+// Ieșirea comenzilor: stdout, sau bufferul arenei reluate de thread-ul
+// curent (--parallel).
+THREAD_LOCAL FILE* out_file;
+// Bufferele comenzilor care își formatează ieșirea înainte de a o scrie
+// (PMAP, READV, WRITEV, COMPACT), golite la sfârșitul fiecăreia.
+THREAD_LOCAL out_buf command_out, command_payload;
+// Suma de control a unui grup din jurnal, pe patru benzi de câte 8 octeți.
+// Rezultatul nu depinde de bucățile în care sunt adăugați octeții.
+typedef struct journal_sum {
+  uint64_t lanes[4];
+  uint8_t tail[32];
+  size_t tail_size;
+  uint64_t length;
+} journal_sum;
+// Jurnalul comenzilor care au modificat arenele (--journal), în formatul
+// modului binar. Comenzile sunt grupate: fiecare grup începe cu un OP_COMMIT
+// care îi dă lungimea și suma de control și ajunge pe disc cu un singur
+// fdatasync, după group_ops comenzi sau când a depășit group_ns. La pornire
+// se reiau grupurile întregi, iar un grup rupt de o oprire bruscă e tăiat.
+typedef struct journal_t {
+  int fd;      // -1 dacă jurnalul e oprit
+  char* data;  // înregistrările încă nescrise, cel mult JOURNAL_BUFFER octeți
+  size_t size;
+  uint64_t offset;  // poziția din fișier a lui data
+  uint64_t group;   // poziția antetului grupului curent
+  unsigned int ops, group_ops;
+  uint64_t start_ns, group_ns;
+  journal_sum sum;
+} journal_t;
+journal_t journal = {.fd = -1,
+                     .group_ops = JOURNAL_GROUP_OPS,
+                     .group_ns = JOURNAL_GROUP_US * 1000ull};
+// Arenele, după nume (USE <nume>); comenzile se aplică arenei numelui ales.
+// Toate fac parte din același domeniu, deci o arenă în plus costă doar
+// metadatele ei. Arenele lăsate deoparte de CLONE_ARENA stau în saved, iar
+// DEALLOC_ARENA pe o clonă o aruncă și revine la arena din care a fost creată.
+typedef struct arena_slot {
+  char name[NAME_SIZE];  // "" pentru o intrare nefolosită
+  arena_t* arena;
+  arena_t** saved;
+  size_t depth, capacity;
+  FILE* out;  // ieșirea numelui la reluarea unei urme cu --parallel, sau NULL
+} arena_slot;
+typedef struct arena_table {
+  arena_slot* slots;  // adresare deschisă, capacity e o putere a lui 2
+  size_t count, capacity;
+  size_t live;  // numele care au o arenă
+  arena_slot* current;
+  vma_domain* domain;
+} arena_table;
+typedef struct segment_buf {
+  vma_segment* data;
+  size_t count, capacity;
+} segment_buf;
+// Starea afișării unui READV: segmentul la care s-a ajuns și câți octeți
+// mai are de primit.
+typedef struct readv_output {
+  out_buf* out;
+  const vma_segment* segments;
+  size_t count, next;
+  uint64_t left;
+  int opened;
+} readv_output;
 
-typedef struct arena_t {
-  uint64_t arena_size, free_size;
-  list_t* alloc_list;
-  int no_miniblocks;
-} arena_t;
-list_t* create_block_list() {
-  list_t* list = malloc(sizeof(list_t));
-  if (list == NULL) {
-    printf("Failed to alloc list");
-    return NULL;
-  }
-  list->size = 0;
-  list->head = NULL;
-  list->last = NULL;
-  return list;
-}
-arena_t* alloc_arena(const uint64_t size) {
-  arena_t *arena, *aux;
-  aux = malloc(sizeof(arena_t));
-  if (aux == NULL) {
-    printf("Failed to alloc memory for the arena");
-    return NULL;
-  } else {
-    arena = aux;
+void out_reserve(out_buf* out, size_t extra) {
+  if (out->size + extra <= out->capacity) {
+    return;
+  }
+  size_t capacity = out->capacity != 0 ? out->capacity : OUT_BUFFER_SIZE;
+  while (capacity < out->size + extra) {
+    capacity *= 2;
+  }
+  char* data = realloc(out->data, capacity);
+  if (data == NULL) {
+    printf("Failed to grow output buffer\n");
+    exit(1);
   }
-  arena->arena_size = size;
-  arena->free_size = size;
-  arena->no_miniblocks = 0;
-  arena->alloc_list = create_block_list();
-  return arena;
+  out->data = data;
+  out->capacity = capacity;
 }
-
-miniblock_list* create_miniblock_list() {
-  miniblock_list* list = malloc(sizeof(miniblock_list));
-  list->size = 0;
-  list->head = NULL;
-  list->last = NULL;
-  return list;
-}
-void free_mem_block(block_t* block) {
-  free(((miniblock_list*)block->miniblock_list));
-  free(block);
-}
-void free_mem_miniblock(miniblock_t* miniblock) {
-  free(miniblock->rw_buffer);
-  free(miniblock);
-}
-int check_memory(list_t* list, uint16_t start_address, size_t size,
-                 arena_t* arena) {
-  if (start_address >= arena->arena_size) {
-    printf("The allocated address is outside the size of arena\n");
-    return 0;
+void out_append(out_buf* out, const char* data, size_t size) {
+  out_reserve(out, size);
+  memcpy(out->data + out->size, data, size);
+  out->size += size;
+}
+void out_append_str(out_buf* out, const char* str) {
+  out_append(out, str, strlen(str));
+}
+// Echivalentul lui printf("%lX") și printf("%lu"), fără parsarea formatului.
+void out_append_hex(out_buf* out, uint64_t value) {
+  char digits[16];
+  int n = 0;
+  do {
+    digits[n++] = "0123456789ABCDEF"[value & 0xF];
+    value >>= 4;
+  } while (value != 0);
+  out_reserve(out, n);
+  while (n > 0) {
+    out->data[out->size++] = digits[--n];
   }
-  if (start_address + size > arena->arena_size) {
-    printf("The end address is past the size of the arena\n");
-    return 0;
+}
+void out_append_uint(out_buf* out, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  out_reserve(out, n);
+  while (n > 0) {
+    out->data[out->size++] = digits[--n];
   }
-  block_t* curr;
-  if (list->head == NULL) {
-    return 1;
+}
+void out_flush(out_buf* out, FILE* stream) {
+  if (out->size == 0) {
+    return;
   }
-  curr = list->head;
-  if (start_address <= curr->start_address) {
-    if (start_address + size > curr->start_address) {
-      printf("This zone was already allocated.\n");
-      return 0;
-    }
+  fwrite(out->data, 1, out->size, stream);
+  out->size = 0;
+}
+#define SUM_PRIME 0x9E3779B185EBCA87ull
+void sum_block(uint64_t* lanes, const uint8_t* block) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t word;
+    memcpy(&word, block + 8 * i, sizeof(word));
+    lanes[i] = (lanes[i] ^ word) * SUM_PRIME;
+    lanes[i] = lanes[i] << 31 | lanes[i] >> 33;
   }
-  while (curr->next != NULL) {
-    if (curr->start_address <= start_address &&
-        curr->next->start_address >= start_address) {
-      if (curr->start_address + curr->size > start_address ||
-          start_address + size > curr->next->start_address) {
-        printf("This zone was already allocated.\n");
-        return 0;
-      }
+}
+void sum_init(journal_sum* sum) {
+  for (int i = 0; i < 4; i++) {
+    sum->lanes[i] = i + 1;
+  }
+  sum->tail_size = 0;
+  sum->length = 0;
+}
+void sum_add(journal_sum* sum, const void* data, size_t size) {
+  const uint8_t* bytes = data;
+  if (size == 0) {
+    return;
+  }
+  sum->length += size;
+  if (sum->tail_size > 0) {
+    size_t take = sizeof(sum->tail) - sum->tail_size;
+    if (take > size) {
+      take = size;
     }
-    curr = curr->next;
+    memcpy(sum->tail + sum->tail_size, bytes, take);
+    sum->tail_size += take;
+    bytes += take;
+    size -= take;
+    if (sum->tail_size < sizeof(sum->tail)) {
+      return;
+    }
+    sum_block(sum->lanes, sum->tail);
+    sum->tail_size = 0;
   }
-
-  if (start_address >= curr->start_address) {
-    if (start_address < curr->start_address + curr->size) {
-      printf("This zone was already allocated.\n");
+  for (; size >= sizeof(sum->tail); size -= sizeof(sum->tail)) {
+    sum_block(sum->lanes, bytes);
+    bytes += sizeof(sum->tail);
+  }
+  memcpy(sum->tail, bytes, size);
+  sum->tail_size = size;
+}
+uint64_t sum_value(const journal_sum* sum) {
+  uint64_t lanes[4];
+  uint8_t block[32] = {0};
+  memcpy(lanes, sum->lanes, sizeof(lanes));
+  memcpy(block, sum->tail, sum->tail_size);
+  sum_block(lanes, block);
+  uint64_t value = sum->length;
+  for (int i = 0; i < 4; i++) {
+    value = (value ^ lanes[i]) * SUM_PRIME;
+    value ^= value >> 29;
+  }
+  return value;
+}
+// Jurnalul nu mai poate fi scris: comenzile continuă fără el.
+void journal_fail(void) {
+  fprintf(stderr, "Failed to write the journal\n");
+  close(journal.fd);
+  journal.fd = -1;
+}
+// Scrie înregistrările adunate și, după ele, payload-ul dat, cu un singur
+// apel de sistem.
+int journal_flush(const void* payload, size_t size) {
+  struct iovec iov[2] = {{journal.data, journal.size}, {(void*)payload, size}};
+  struct iovec* next = iov;
+  int count = 2;
+  uint64_t left = journal.size + size;
+  while (left > 0) {
+    ssize_t done = writev(journal.fd, next, count);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
       return 0;
     }
+    left -= done;
+    journal.offset += done;
+    for (; count > 0 && (size_t)done >= next->iov_len; count--, next++) {
+      done -= next->iov_len;
+    }
+    if (count > 0) {
+      next->iov_base = (char*)next->iov_base + done;
+      next->iov_len -= done;
+    }
   }
+  journal.size = 0;
   return 1;
 }
-miniblock_t* create_miniblock(uint64_t start_address, size_t size) {
-  miniblock_t* aux;
-  aux = malloc(sizeof(miniblock_t));
-  if (aux == NULL) {
-    printf("Failed to alloc miniblock");
-    return NULL;
-  }
-  aux->start_address = start_address;
-  aux->size = size;
-  aux->next = NULL;
-  aux->prev = NULL;
-  aux->rw_buffer = malloc(sizeof(char) * size);
-  aux->perm = 6;
-  return aux;
-}
-block_t* remove_block(list_t* list, unsigned int n) {
-  block_t* aux;
-  if (list->size == 1) {
-    aux = list->head;
-    list->head = NULL;
-  } else if (n == 0) {
-    aux = list->head;
-    list->head->next->prev = NULL;
-    list->head = list->head->next;
-  } else if (n >= list->size - 1) {
-    aux = list->last;
-    list->last->prev->next = NULL;
-    list->last = list->last->prev;
+// Face durabil grupul curent: antetul lui, scris gol la început, primește
+// lungimea și suma de control, apoi totul ajunge pe disc.
+void journal_commit(void) {
+  if (journal.fd < 0 || journal.ops == 0) {
+    return;
+  }
+  command_record header = {OP_COMMIT, {0}, sum_value(&journal.sum),
+                           journal.sum.length};
+  journal.ops = 0;
+  if (!journal_flush(NULL, 0) ||
+      pwrite(journal.fd, &header, sizeof(header), journal.group) !=
+          (ssize_t)sizeof(header) ||
+      fdatasync(journal.fd) != 0) {
+    journal_fail();
+  }
+}
+int journal_reserve(size_t size) {
+  return journal.size + size <= JOURNAL_BUFFER || journal_flush(NULL, 0);
+}
+// Adaugă o comandă care a modificat o arenă, urmată de tail (operandul,
+// numele, payload-ul). Payload-urile lungi nu sunt copiate în jurnal: sunt
+// scrise direct de unde se află, împreună cu înregistrările adunate.
+void journal_add(uint8_t opcode, uint64_t address, uint64_t size,
+                 const void* tail, uint64_t tail_size) {
+  command_record record = {opcode, {0}, address, size};
+  if (journal.fd < 0) {
+    return;
+  }
+  if (journal.ops == 0) {
+    if (!journal_reserve(sizeof(record))) {
+      journal_fail();
+      return;
+    }
+    journal.group = journal.offset + journal.size;
+    memset(journal.data + journal.size, 0, sizeof(record));
+    journal.size += sizeof(record);
+    sum_init(&journal.sum);
+    journal.start_ns = vma_now_ns();
+  }
+  sum_add(&journal.sum, &record, sizeof(record));
+  sum_add(&journal.sum, tail, tail_size);
+  int written = journal_reserve(sizeof(record) + JOURNAL_INLINE);
+  if (written) {
+    memcpy(journal.data + journal.size, &record, sizeof(record));
+    journal.size += sizeof(record);
+    if (tail_size > JOURNAL_INLINE) {
+      written = journal_flush(tail, tail_size);
+    } else if (tail_size > 0) {
+      memcpy(journal.data + journal.size, tail, tail_size);
+      journal.size += tail_size;
+    }
+  }
+  if (!written) {
+    journal_fail();
+    return;
+  }
+  if (++journal.ops >= journal.group_ops ||
+      vma_now_ns() - journal.start_ns >= journal.group_ns) {
+    journal_commit();
+  }
+}
+size_t read_payload(void* ctx, int8_t* dst, size_t size) {
+  payload_source* src = ctx;
+  size_t got;
+  if (src->prefix_size > 0) {
+    got = size < src->prefix_size ? size : src->prefix_size;
+    memcpy(dst, src->prefix, got);
+    src->prefix += got;
+    src->prefix_size -= got;
   } else {
-    block_t* curr = list->head;
-    for (unsigned int i = 0; i < n - 1; i++) {
-      curr = curr->next;
+    got = fread(dst, 1, size, src->in);
+  }
+  if (got > 0) {
+    src->last = (uint8_t)dst[got - 1];
+    if (src->tee != NULL) {
+      out_append(src->tee, (const char*)dst, got);
     }
-    aux = curr->next;
-    curr->next = aux->next;
-    aux->next->prev = aux->prev;
   }
-  list->size--;
-  return aux;
+  return got;
 }
-int check_neighbors(list_t* list, uint64_t start_address, size_t size) {
-  if (list->head == NULL) {
+// Ca în protocolul original, un READ/WRITE care depășește blocul e anunțat
+// doar dacă pornește din ultimul miniblock (un READ, chiar de la începutul
+// lui); unul care trece peste mai multe miniblock-uri e limitat în tăcere.
+int warn_truncated(arena_t* arena, uint64_t address, int write) {
+  uint64_t last;
+  if (vma_last_miniblock(arena, address, &last) != VMA_OK) {
     return 1;
   }
-  block_t* curr = list->head;
-  if (list->head->next == NULL) {
-    if (start_address + size == curr->start_address) {
-      miniblock_t* aux;
-      aux = create_miniblock(start_address, size);
-      aux->next = ((miniblock_list*)curr->miniblock_list)->head;
-      ((miniblock_list*)curr->miniblock_list)->head->prev = aux;
-      ((miniblock_list*)curr->miniblock_list)->head = aux;
-      ((miniblock_list*)curr->miniblock_list)->size++;
-      curr->start_address = start_address;
-      curr->size += size;
-      return 0;
+  return write ? address >= last : address == last;
+}
+// Payload-ul este citit direct în arenă, fără copie intermediară. Octeții
+// care nu încap în bloc sunt consumați și ignorați. Jurnalul ia payload-ul
+// din arenă, unde tocmai a fost scris; doar pe o arenă cu compresie el e
+// copiat și în command_payload, fiindcă pagina scrisă poate fi comprimată
+// chiar la sfârșitul operației.
+void write_command(arena_t* arena, const uint64_t address,
+                   const uint64_t size, payload_source* src) {
+  static THREAD_LOCAL int8_t discard[4096];
+  VMA_TIMER_START(start);
+  uint64_t written = size;
+  const void* journaled = arena->data + address;
+  if (journal.fd >= 0 && arena->pack_after != 0) {
+    command_payload.size = 0;
+    src->tee = &command_payload;
+  }
+  vma_status status =
+      vma_write_from(arena, address, &written, read_payload, src);
+  if (src->tee != NULL) {
+    journaled = command_payload.data;
+    src->tee = NULL;
+  }
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for write.\n");
+  } else if (status == VMA_NO_PERMISSION) {
+    fprintf(out_file, "Invalid permissions for write.\n");
+  } else if (status == VMA_TRUNCATED && warn_truncated(arena, address, 1)) {
+    fprintf(out_file,
+            "Warning: size was bigger than the block size. Writing %lu "
+            "characters.\n",
+            written);
+  }
+  if ((status == VMA_OK || status == VMA_TRUNCATED) && written > 0) {
+    journal_add(OP_WRITE, address, written, journaled, written);
+  }
+  for (uint64_t left = size - written; left > 0;) {
+    size_t got = read_payload(
+        src, discard, left < sizeof(discard) ? left : sizeof(discard));
+    if (got == 0) {
+      break;
     }
+    left -= got;
   }
-  unsigned int i = 0;
-  while (curr->next != NULL) {
-    if (curr->start_address + curr->size == start_address &&
-        curr->next->start_address == start_address + size) {
-      miniblock_t* aux;
-      aux = create_miniblock(start_address, size);
-      ((miniblock_list*)curr->miniblock_list)->last->next = aux;
-      aux->prev = ((miniblock_list*)curr->miniblock_list)->last;
-      ((miniblock_list*)curr->miniblock_list)->last = aux;
-      ((miniblock_list*)curr->next->miniblock_list)->head->prev = aux;
-      aux->next = ((miniblock_list*)curr->next->miniblock_list)->head;
-      ((miniblock_list*)curr->miniblock_list)->last =
-          ((miniblock_list*)curr->next->miniblock_list)->last;
-      ((miniblock_list*)curr->miniblock_list)->size++;
-      ((miniblock_list*)curr->miniblock_list)->size +=
-          ((miniblock_list*)curr->next->miniblock_list)->size;
-      curr->size += size;
-      curr->size += curr->next->size;
-      block_t* erase = remove_block(list, i + 1);
-      free_mem_block(erase);
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_WRITE], start);
+}
+void print_range(void* ctx, const int8_t* src, size_t size) {
+  fwrite(src, 1, size, ctx);
+}
+// Datele citite sunt adiacente în arenă și sunt scrise cu un singur fwrite.
+void read_command(arena_t* arena, uint64_t address, uint64_t size) {
+  VMA_TIMER_START(start);
+  vma_status status = vma_resolve(arena, address, &size, VMA_PROT_READ);
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for read.\n");
+  } else if (status == VMA_NO_PERMISSION) {
+    fprintf(out_file, "Invalid permissions for read.\n");
+  } else {
+    if (status == VMA_TRUNCATED && warn_truncated(arena, address, 0)) {
+      fprintf(out_file,
+              "Warning: size was bigger than the block size. Reading %lu "
+              "characters.\n",
+              size);
+    }
+    vma_read_to(arena, address, &size, print_range, out_file);
+    fputc('\n', out_file);
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_READ], start);
+}
+int segments_push(segment_buf* segments, uint64_t address, uint64_t size) {
+  if (segments->count == segments->capacity) {
+    size_t capacity = segments->capacity != 0 ? 2 * segments->capacity : 64;
+    vma_segment* data =
+        realloc(segments->data, capacity * sizeof(*segments->data));
+    if (data == NULL) {
       return 0;
-    } else if (curr->start_address + curr->size == start_address) {
-      miniblock_t* aux;
-      aux = create_miniblock(start_address, size);
-      ((miniblock_list*)curr->miniblock_list)->last->next = aux;
-      aux->prev = ((miniblock_list*)curr->miniblock_list)->last;
-      ((miniblock_list*)curr->miniblock_list)->last = aux;
-      ((miniblock_list*)curr->miniblock_list)->size++;
-      curr->size += size;
+    }
+    segments->data = data;
+    segments->capacity = capacity;
+  }
+  vma_segment segment = {address, size, 0, VMA_OK};
+  segments->data[segments->count++] = segment;
+  return 1;
+}
+// Trece de segmentele fără date rămase, afișând pentru fiecare mesajul
+// (sau avertismentul) înaintea datelor și '\n' după ele.
+void readv_advance(readv_output* output) {
+  while (output->next < output->count) {
+    const vma_segment* segment = &output->segments[output->next];
+    if (!output->opened) {
+      output->opened = 1;
+      output->left = 0;
+      if (segment->status == VMA_INVALID_ADDRESS) {
+        out_append_str(output->out, "Invalid address for read.\n");
+      } else if (segment->status == VMA_NO_PERMISSION) {
+        out_append_str(output->out, "Invalid permissions for read.\n");
+      } else {
+        if (segment->status == VMA_TRUNCATED) {
+          out_append_str(output->out,
+                         "Warning: size was bigger than the block size. "
+                         "Reading ");
+          out_append_uint(output->out, segment->done);
+          out_append_str(output->out, " characters.\n");
+        }
+        output->left = segment->done;
+      }
+    }
+    if (output->left > 0) {
+      return;
+    }
+    if (segment->status == VMA_OK || segment->status == VMA_TRUNCATED) {
+      out_append_str(output->out, "\n");
+    }
+    output->opened = 0;
+    output->next++;
+  }
+}
+void readv_sink(void* ctx, const int8_t* src, size_t size) {
+  readv_output* output = ctx;
+  while (size > 0) {
+    readv_advance(output);
+    size_t part = size < output->left ? size : output->left;
+    out_append(output->out, (const char*)src, part);
+    output->left -= part;
+    src += part;
+    size -= part;
+  }
+}
+// Segmentele sunt rezolvate împreună, iar mesajele și datele lor, în ordinea
+// cererii, ajung în același buffer, scris o singură dată.
+void readv_command(arena_t* arena, segment_buf* segments) {
+  out_buf* out = &command_out;
+  VMA_TIMER_START(start);
+  readv_output output = {out, segments->data, segments->count, 0, 0, 0};
+  vma_readv(arena, segments->data, segments->count, readv_sink, &output);
+  readv_advance(&output);
+  VMA_TIMER_START(output_start);
+  out_flush(out, out_file);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_OUTPUT], output_start);
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_READV], start);
+}
+// Payload-urile tuturor segmentelor sunt citite înainte de transfer; dacă
+// stream-ul se termină mai devreme, segmentele sunt scurtate la ce s-a primit.
+void writev_command(arena_t* arena, segment_buf* segments,
+                    payload_source* src) {
+  out_buf *payload = &command_payload, *out = &command_out;
+  VMA_TIMER_START(start);
+  uint64_t total = 0;
+  for (size_t i = 0; i < segments->count; i++) {
+    total += segments->data[i].size;
+  }
+  payload->size = 0;
+  while (payload->size < total) {
+    uint64_t want = total - payload->size;
+    if (want > OUT_BUFFER_SIZE) {
+      want = OUT_BUFFER_SIZE;
+    }
+    out_reserve(payload, want);
+    size_t got =
+        read_payload(src, (int8_t*)payload->data + payload->size, want);
+    if (got == 0) {
+      break;
+    }
+    payload->size += got;
+  }
+  uint64_t left = payload->size;
+  for (size_t i = 0; i < segments->count && payload->size < total; i++) {
+    if (segments->data[i].size > left) {
+      segments->data[i].size = left;
+    }
+    left -= segments->data[i].size;
+  }
+  vma_writev(arena, segments->data, segments->count,
+             (const int8_t*)payload->data);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < segments->count; i++) {
+    const vma_segment* segment = &segments->data[i];
+    if (segment->status == VMA_INVALID_ADDRESS) {
+      out_append_str(out, "Invalid address for write.\n");
+    } else if (segment->status == VMA_NO_PERMISSION) {
+      out_append_str(out, "Invalid permissions for write.\n");
+    } else if (segment->status == VMA_TRUNCATED) {
+      out_append_str(out,
+                     "Warning: size was bigger than the block size. Writing ");
+      out_append_uint(out, segment->done);
+      out_append_str(out, " characters.\n");
+    }
+    // În jurnal, fiecare segment scris devine un WRITE, cu octeții luați
+    // din payload.
+    if ((segment->status == VMA_OK || segment->status == VMA_TRUNCATED) &&
+        segment->done > 0) {
+      journal_add(OP_WRITE, segment->address, segment->done,
+                  payload->data + offset, segment->done);
+    }
+    offset += segment->size;
+  }
+  VMA_TIMER_START(output_start);
+  out_flush(out, out_file);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_OUTPUT], output_start);
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_WRITEV], start);
+}
+// Citește un număr zecimal și întoarce octetul de după el, sau 0 dacă nu
+// începe cu o cifră. Sfârșitul stream-ului contează ca '\n'.
+int read_number(payload_source* src, uint64_t* value) {
+  int8_t c;
+  int digits = 0;
+  *value = 0;
+  while (read_payload(src, &c, 1) == 1) {
+    if (c < '0' || c > '9') {
+      return digits > 0 ? (unsigned char)c : 0;
+    }
+    *value = *value * 10 + (c - '0');
+    digits++;
+  }
+  return digits > 0 ? '\n' : 0;
+}
+// Citește "<n> <address_1> <size_1> ... <address_n> <size_n>", urmat de
+// separatorul end. Întoarce 0 dacă linia nu respectă formatul.
+int parse_segments(payload_source* src, segment_buf* segments, int end) {
+  uint64_t count, address, size;
+  segments->count = 0;
+  int sep = read_number(src, &count);
+  if (count == 0) {
+    return sep == ' ' || sep == '\n';
+  }
+  if (sep != ' ') {
+    return 0;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    if (read_number(src, &address) != ' ') {
       return 0;
-    } else if (curr->next->start_address == start_address + size) {
-      miniblock_t* aux;
-      aux = create_miniblock(start_address, size);
-      ((miniblock_list*)curr->next->miniblock_list)->head->prev = aux;
-      aux->next = ((miniblock_list*)curr->next->miniblock_list)->head;
-      ((miniblock_list*)curr->next->miniblock_list)->head = aux;
-      ((miniblock_list*)curr->next->miniblock_list)->size++;
-      curr->next->start_address = start_address;
-      curr->next->size += size;
+    }
+    sep = read_number(src, &size);
+    if (sep != (i + 1 < count ? ' ' : end) ||
+        !segments_push(segments, address, size)) {
       return 0;
     }
-    curr = curr->next;
-    i++;
-  }
-  if (curr->start_address + curr->size == start_address) {
-    miniblock_t* aux;
-    aux = create_miniblock(start_address, size);
-    ((miniblock_list*)curr->miniblock_list)->last->next = aux;
-    aux->prev = ((miniblock_list*)curr->miniblock_list)->last;
-    ((miniblock_list*)curr->miniblock_list)->last = aux;
-    ((miniblock_list*)curr->miniblock_list)->size++;
-    curr->size += size;
+  }
+  return 1;
+}
+void print_relocation(void* ctx, uint64_t old_address, uint64_t new_address,
+                      uint64_t size) {
+  out_buf* out = ctx;
+  out_append_str(out, "Block 0x");
+  out_append_hex(out, old_address);
+  out_append_str(out, " - 0x");
+  out_append_hex(out, old_address + size);
+  out_append_str(out, " moved to 0x");
+  out_append_hex(out, new_address);
+  out_append_str(out, "\n");
+}
+// Harta de relocare, apoi costul și fragmentarea înainte și după.
+void compact_command(arena_t* arena) {
+  out_buf* out = &command_out;
+  vma_compact_report report;
+  VMA_TIMER_START(start);
+  vma_compact(arena, print_relocation, out, &report);
+  out_flush(out, out_file);
+  // Durata apare doar în STATS, ca ieșirea comenzii să nu depindă de rulare.
+  fprintf(out_file, "Compacted %" PRIu64 " blocks, 0x%" PRIX64 " bytes moved\n",
+          report.blocks_moved, report.bytes_moved);
+  fprintf(out_file, "Fragmentation: %.2f%% -> %.2f%%\n",
+          100 * report.fragmentation_before, 100 * report.fragmentation_after);
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_COMPACT], start);
+}
+void compress_command(arena_t* arena, uint64_t idle_ops) {
+  if (vma_set_compression(arena, idle_ops) != VMA_OK) {
+    fprintf(out_file, "Failed to reserve memory for the arena\n");
+    return;
+  }
+  journal_add(OP_COMPRESS, idle_ops, 0, NULL, 0);
+}
+void save_command(arena_t* arena, const char* path) {
+  if (vma_save(arena, path) != VMA_OK) {
+    fprintf(out_file, "Failed to save the arena\n");
+  }
+}
+uint64_t name_hash(const char* name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (; *name != '\0'; name++) {
+    hash = (hash ^ (unsigned char)*name) * 1099511628211ull;
+  }
+  return hash;
+}
+// Intrarea numelui, creată dacă nu există; NULL dacă memoria nu ajunge.
+arena_slot* find_slot(arena_table* table, const char* name) {
+  if (2 * (table->count + 1) > table->capacity) {
+    size_t capacity = table->capacity != 0 ? 2 * table->capacity : 16;
+    arena_slot* slots = calloc(capacity, sizeof(arena_slot));
+    if (slots == NULL) {
+      return NULL;
+    }
+    arena_slot* current = NULL;
+    for (size_t i = 0; i < table->capacity; i++) {
+      arena_slot* slot = &table->slots[i];
+      if (slot->name[0] == '\0') {
+        continue;
+      }
+      size_t j = name_hash(slot->name) & (capacity - 1);
+      while (slots[j].name[0] != '\0') {
+        j = (j + 1) & (capacity - 1);
+      }
+      slots[j] = *slot;
+      if (slot == table->current) {
+        current = &slots[j];
+      }
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    table->current = current;
+  }
+  size_t i = name_hash(name) & (table->capacity - 1);
+  while (table->slots[i].name[0] != '\0') {
+    if (strcmp(table->slots[i].name, name) == 0) {
+      return &table->slots[i];
+    }
+    i = (i + 1) & (table->capacity - 1);
+  }
+  strcpy(table->slots[i].name, name);
+  table->count++;
+  return &table->slots[i];
+}
+int use_command(arena_table* table, const char* name) {
+  if (strlen(name) >= NAME_SIZE) {
+    return 0;
+  }
+  arena_slot* slot = find_slot(table, name);
+  if (slot == NULL) {
     return 0;
   }
+  table->current = slot;
+  journal_add(OP_USE, 0, strlen(name), name, strlen(name));
   return 1;
 }
-block_t* create_block(const uint64_t start_address, size_t size) {
-  block_t* block = malloc(sizeof(block_t));
-  block->start_address = start_address;
-  block->size = size;
-  block->next = NULL;
-  block->prev = NULL;
-  block->miniblock_list = create_miniblock_list();
-
-  return block;
+// Eliberează arena numelui curent, cu tot cu arenele lăsate deoparte.
+void drop_slot(arena_table* table) {
+  arena_slot* slot = table->current;
+  if (slot->arena == NULL) {
+    return;
+  }
+  dealloc_arena(slot->arena);
+  while (slot->depth > 0) {
+    dealloc_arena(slot->saved[--slot->depth]);
+  }
+  slot->arena = NULL;
+  table->live--;
 }
-void add_block(list_t* list, uint64_t start_address, size_t size,
-               unsigned int n) {
-  block_t* block = create_block(start_address, size);
-
-  if (list->size == 0) {
-    list->head = block;
-    list->last = block;
-
-  } else if (n == 0) {
-    block->next = list->head;
-    list->head->prev = block;
-    list->head = block;
-  } else if (n >= list->size - 1) {
-    block->prev = list->last;
-    list->last->next = block;
-    list->last = block;
+void set_arena(arena_table* table, arena_t* arena) {
+  if (table->current->arena == NULL) {
+    table->live++;
+  }
+  table->current->arena = arena;
+}
+// Arenele rămase la sfârșitul intrării nu sunt eliberate; domeniul dispare
+// odată cu ultima dintre ele.
+void free_table(arena_table* table) {
+  for (size_t i = 0; i < table->capacity; i++) {
+    free(table->slots[i].saved);
+  }
+  free(table->slots);
+  if (table->domain != NULL) {
+    vma_domain_destroy(table->domain);
+  }
+}
+// O arenă nouă înlocuiește complet ce avea numele înainte.
+void alloc_arena_command(arena_table* table, uint64_t size) {
+  arena_t* arena = alloc_arena_in(table->domain, size);
+  if (arena == NULL) {
+    return;
+  }
+  drop_slot(table);
+  set_arena(table, arena);
+  journal_add(OP_ALLOC_ARENA, size, 0, NULL, 0);
+}
+// Arena curentă e înlocuită doar dacă snapshot-ul a fost încărcat.
+void load_command(arena_table* table, const char* path) {
+  arena_t* loaded;
+  if (vma_load_in(table->domain, path, &loaded) != VMA_OK) {
+    fprintf(out_file, "Failed to load the arena\n");
+    return;
+  }
+  if (table->current->arena != NULL) {
+    dealloc_arena(table->current->arena);
+  }
+  set_arena(table, loaded);
+  journal_add(OP_LOAD, 0, strlen(path), path, strlen(path));
+}
+void clone_command(arena_table* table) {
+  arena_slot* slot = table->current;
+  arena_t* clone;
+  if (slot->depth == slot->capacity) {
+    size_t capacity = slot->capacity != 0 ? 2 * slot->capacity : 4;
+    arena_t** saved = realloc(slot->saved, capacity * sizeof(arena_t*));
+    if (saved == NULL) {
+      fprintf(out_file, "Failed to clone the arena\n");
+      return;
+    }
+    slot->saved = saved;
+    slot->capacity = capacity;
+  }
+  if (vma_clone(slot->arena, &clone) != VMA_OK) {
+    fprintf(out_file, "Failed to clone the arena\n");
+    return;
+  }
+  slot->saved[slot->depth++] = slot->arena;
+  slot->arena = clone;
+  journal_add(OP_CLONE_ARENA, 0, 0, NULL, 0);
+}
+// Întoarce câte nume mai au o arenă.
+size_t dealloc_command(arena_table* table) {
+  arena_slot* slot = table->current;
+  dealloc_arena(slot->arena);
+  journal_add(OP_DEALLOC_ARENA, 0, 0, NULL, 0);
+  if (slot->depth > 0) {
+    slot->arena = slot->saved[--slot->depth];
   } else {
-    block_t* curr = list->head;
-    for (unsigned int i = 0; i < n - 1; i++) {
-      curr = curr->next;
-    }
-    block->next = curr->next;
-    block->prev = curr;
-    curr->next = block;
-    block->next->prev = block;
-  }
-  list->size++;
-}
-void alloc_block(arena_t* arena, const uint64_t start_address,
-                 const uint64_t size) {
-  if (check_memory(arena->alloc_list, start_address, size, arena)) {
-    arena->free_size -= size;
-    arena->no_miniblocks++;
-    if (check_neighbors(arena->alloc_list, start_address, size)) {
-      block_t* block = create_block(start_address, size);
-      ((miniblock_list*)block->miniblock_list)->head =
-          create_miniblock(start_address, size);
-      ((miniblock_list*)block->miniblock_list)->last =
-          ((miniblock_list*)block->miniblock_list)->head;
-      ((miniblock_list*)block->miniblock_list)->size = 1;
-      if (((list_t*)arena->alloc_list)->size == 0) {
-        arena->alloc_list->head = block;
-        arena->alloc_list->last = block;
-        arena->alloc_list->size++;
-        return;
-      }
-      if (block->start_address < arena->alloc_list->head->start_address) {
-        block->next = arena->alloc_list->head;
-        arena->alloc_list->head->prev = block;
-        arena->alloc_list->head = block;
-        arena->alloc_list->size++;
-        return;
-
-      } else if (block->start_address >
-                 arena->alloc_list->last->start_address) {
-        arena->alloc_list->last->next = block;
-        block->prev = arena->alloc_list->last;
-        arena->alloc_list->last = block;
-        arena->alloc_list->size++;
-      } else {
-        block_t* curr = arena->alloc_list->head;
-        while (curr->next != NULL) {
-          if (curr->start_address < block->start_address &&
-              curr->next->start_address > block->start_address) {
-            block->next = curr->next;
-            block->prev = curr;
-            curr->next = block;
-            block->next->prev = block;
-          }
-          curr = curr->next;
-        }
-        arena->alloc_list->size++;
+    slot->arena = NULL;
+    table->live--;
+  }
+  return table->live;
+}
+void alloc_command(arena_t* arena, const uint64_t address,
+                   const uint64_t size) {
+  VMA_TIMER_START(start);
+  vma_status status = alloc_block(arena, address, size);
+  switch (status) {
+    case VMA_OUTSIDE_ARENA:
+      fprintf(out_file, "The allocated address is outside the size of arena\n");
+      break;
+    case VMA_END_PAST_ARENA:
+      fprintf(out_file, "The end address is past the size of the arena\n");
+      break;
+    case VMA_ALREADY_ALLOCATED:
+      fprintf(out_file, "This zone was already allocated.\n");
+      break;
+    case VMA_NO_MEMORY:
+      fprintf(out_file, "Failed to reserve memory for the arena\n");
+      break;
+    default:
+      journal_add(OP_ALLOC_BLOCK, address, size, NULL, 0);
+      break;
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_ALLOC_BLOCK], start);
+}
+void alloc_any_command(arena_t* arena, const uint64_t size, vma_fit policy) {
+  uint64_t address;
+  VMA_TIMER_START(start);
+  vma_status status = alloc_any(arena, size, policy, &address);
+  if (status == VMA_NO_FIT && compact_threshold != 0 &&
+      arena->free_size >= size) {
+    compact_command(arena);
+    status = alloc_any(arena, size, policy, &address);
+  }
+  if (status == VMA_OK) {
+    fprintf(out_file, "Allocated address: 0x%" PRIX64 "\n", address);
+    journal_add(OP_ALLOC_ANY, policy, size, NULL, 0);
+  } else if (status == VMA_NO_FIT) {
+    fprintf(out_file, "There is no free zone large enough.\n");
+  } else if (status == VMA_NO_MEMORY) {
+    fprintf(out_file, "Failed to reserve memory for the arena\n");
+  } else {
+    fprintf(out_file, "This zone was already allocated.\n");
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_ALLOC_BLOCK], start);
+}
+void mprotect_command(arena_t* arena, const uint64_t address,
+                      const uint8_t perm) {
+  if (vma_mprotect(arena, address, perm) == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for mprotect.\n");
+  } else {
+    journal_add(OP_MPROTECT, address, perm, NULL, 0);
+  }
+}
+void memset_command(arena_t* arena, const uint64_t address, uint64_t size,
+                    const uint8_t value) {
+  VMA_TIMER_START(start);
+  vma_status status = vma_memset(arena, address, &size, value);
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for memset.\n");
+  } else if (status == VMA_NO_PERMISSION) {
+    fprintf(out_file, "Invalid permissions for memset.\n");
+  } else if (status == VMA_TRUNCATED) {
+    fprintf(out_file,
+            "Warning: size was bigger than the block size. Writing %" PRIu64
+            " characters.\n",
+            size);
+  }
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    uint64_t operand = value;
+    journal_add(OP_MEMSET, address, size, &operand, sizeof(operand));
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_MEMSET], start);
+}
+void memmove_command(arena_t* arena, const uint64_t dst, const uint64_t src,
+                     uint64_t size) {
+  VMA_TIMER_START(start);
+  vma_status status = vma_memmove(arena, dst, src, &size);
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for memmove.\n");
+  } else if (status == VMA_NO_PERMISSION) {
+    fprintf(out_file, "Invalid permissions for memmove.\n");
+  } else if (status == VMA_TRUNCATED) {
+    fprintf(out_file,
+            "Warning: size was bigger than the block size. Moving %" PRIu64
+            " characters.\n",
+            size);
+  }
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    journal_add(OP_MEMMOVE, dst, size, &src, sizeof(src));
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_MEMMOVE], start);
+}
+void find_command(arena_t* arena, const uint64_t address, uint64_t size,
+                  const int8_t* pattern, const uint64_t length) {
+  VMA_TIMER_START(start);
+  uint64_t found;
+  vma_status status = vma_find(arena, address, &size, pattern, length, &found);
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for find.\n");
+  } else if (status == VMA_NO_PERMISSION) {
+    fprintf(out_file, "Invalid permissions for find.\n");
+  } else if (status == VMA_NO_MEMORY) {
+    fprintf(out_file, "Failed to find the pattern\n");
+  } else {
+    if (status == VMA_TRUNCATED) {
+      fprintf(out_file,
+              "Warning: size was bigger than the block size. Searching %" PRIu64
+              " characters.\n",
+              size);
+    }
+    if (found != VMA_NOT_FOUND) {
+      fprintf(out_file, "Found at 0x%" PRIX64 "\n", found);
+    } else {
+      fprintf(out_file, "Pattern not found.\n");
+    }
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_FIND], start);
+}
+void free_command(arena_t* arena, const uint64_t address) {
+  VMA_TIMER_START(start);
+  vma_status status = free_block(arena, address);
+  if (status == VMA_INVALID_ADDRESS) {
+    fprintf(out_file, "Invalid address for free.\n");
+  } else if (status == VMA_NO_MEMORY) {
+    fprintf(out_file, "Failed to alloc block\n");
+  } else {
+    journal_add(OP_FREE_BLOCK, address, 0, NULL, 0);
+  }
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_FREE_BLOCK], start);
+  if (status == VMA_OK && compact_threshold != 0 &&
+      100 * vma_fragmentation(arena) > compact_threshold) {
+    compact_command(arena);
+  }
+}
+// Harta este formatată într-un buffer refolosit între apeluri și scrisă
+// o singură dată.
+void pmap(arena_t* arena) {
+  out_buf* out = &command_out;
+  VMA_TIMER_START(start);
+  out_append_str(out, "Total memory: 0x");
+  out_append_hex(out, arena->arena_size);
+  out_append_str(out, " bytes\nFree memory: 0x");
+  out_append_hex(out, arena->free_size);
+  out_append_str(out, " bytes\nNumber of allocated blocks: ");
+  out_append_uint(out, arena->alloc_list->size);
+  out_append_str(out, "\nNumber of allocated miniblocks: ");
+  out_append_uint(out, arena->no_miniblocks);
+  out_append_str(out, "\n");
+  block_t* curr = arena->alloc_list->head;
+  for (unsigned int i = 1; curr != NULL; i++) {
+    out_append_str(out, "\nBlock ");
+    out_append_uint(out, i);
+    out_append_str(out, " begin\nZone: 0x");
+    out_append_hex(out, curr->start_address);
+    out_append_str(out, " - 0x");
+    out_append_hex(out, curr->start_address + curr->size);
+    out_append_str(out, "\n");
+    miniblock_t* currm = curr->miniblocks.head;
+    for (unsigned int j = 1; currm != NULL; j++) {
+      out_append_str(out, "Miniblock ");
+      out_append_uint(out, j);
+      out_append_str(out, ":\t\t0x");
+      out_append_hex(out, currm->start_address);
+      out_append_str(out, "\t\t-\t\t0x");
+      out_append_hex(out, currm->start_address + currm->size);
+      char perm[] = "\t\t| ---\n";
+      perm[4] = currm->perm & VMA_PROT_READ ? 'R' : '-';
+      perm[5] = currm->perm & VMA_PROT_WRITE ? 'W' : '-';
+      perm[6] = currm->perm & VMA_PROT_EXEC ? 'X' : '-';
+      out_append(out, perm, sizeof(perm) - 1);
+      currm = currm->next;
+    }
+    out_append_str(out, "Block ");
+    out_append_uint(out, i);
+    out_append_str(out, " end\n");
+    curr = curr->next;
+  }
+  VMA_TIMER_START(output_start);
+  out_flush(out, out_file);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_OUTPUT], output_start);
+  VMA_TIMER_STOP(arena, commands[VMA_CMD_PMAP], start);
+}
+#ifdef VMA_STATS
+void print_hist(const char* name, const vma_hist* hist) {
+  fprintf(out_file, "%-16s count: %" PRIu64 "\ttotal: %" PRIu64 " ns", name,
+          hist->count, hist->total_ns);
+  if (hist->count != 0) {
+    fprintf(out_file, "\tp50: <%" PRIu64 " ns\tp99: <%" PRIu64 " ns\n",
+            vma_hist_percentile(hist, 50), vma_hist_percentile(hist, 99));
+    for (int i = 0; i < VMA_HIST_BUCKETS; i++) {
+      if (hist->buckets[i] != 0) {
+        fprintf(out_file, "  <%" PRIu64 " ns: %" PRIu64 "\n",
+                (uint64_t)2 << i, hist->buckets[i]);
       }
     }
+  } else {
+    fputc('\n', out_file);
+  }
+}
+// Cât din căutări au fost rezolvate lângă cursorul de localitate.
+void print_cursor(const char* name, uint64_t hits, uint64_t misses) {
+  uint64_t total = hits + misses;
+  fprintf(out_file,
+          "%s cursor: %" PRIu64 " hits, %" PRIu64 " misses (%.2f%% hits)\n",
+          name, hits, misses, total != 0 ? 100.0 * hits / total : 0.0);
+}
+#endif
+// Aceleași totaluri ca PMAP, urmate de contoarele și histogramele arenei.
+void stats(arena_t* arena) {
+  fprintf(out_file, "Total memory: 0x%" PRIX64 " bytes\n", arena->arena_size);
+  fprintf(out_file, "Free memory: 0x%" PRIX64 " bytes\n", arena->free_size);
+  fprintf(out_file, "Number of allocated blocks: %u\n",
+          arena->alloc_list->size);
+  fprintf(out_file, "Number of allocated miniblocks: %d\n",
+          arena->no_miniblocks);
+  fprintf(out_file, "Committed memory: 0x%" PRIX64 " bytes\n",
+          arena->committed_pages << arena->page_shift);
+  uint64_t metadata = vma_metadata_size(arena);
+  fprintf(out_file,
+          "Metadata: 0x%" PRIX64 " bytes (%.2f bytes per miniblock)\n",
+          metadata,
+          arena->no_miniblocks != 0 ? (double)metadata / arena->no_miniblocks
+                                    : 0.0);
+  uint64_t packed = arena->packed_pages << arena->page_shift;
+  fprintf(out_file,
+          "Compressed memory: 0x%" PRIX64 " bytes in 0x%" PRIX64
+          " bytes (%.2f%%)\n",
+          packed, arena->packed_bytes,
+          packed != 0 ? 100.0 * arena->packed_bytes / packed : 0.0);
+#ifdef VMA_STATS
+  const char* commands[VMA_COMMANDS] = {
+      "ALLOC_BLOCK", "FREE_BLOCK", "WRITE",  "READ",    "PMAP", "READV",
+      "WRITEV",      "COMPACT",    "MEMSET", "MEMMOVE", "FIND"};
+  const char* phases[VMA_PHASES] = {
+      "check_memory", "check_neighbors", "split_block", "copy",
+      "pack",         "inflate",         "output"};
+  fprintf(out_file, "Nodes visited: %" PRIu64 "\n", arena->stats.nodes_visited);
+  fprintf(out_file, "Merges: %" PRIu64 "\n", arena->stats.merges);
+  fprintf(out_file, "Splits: %" PRIu64 "\n", arena->stats.splits);
+  fprintf(out_file, "Bytes copied: %" PRIu64 "\n", arena->stats.bytes_copied);
+  print_cursor("Block", arena->stats.block_hits, arena->stats.block_misses);
+  print_cursor("Miniblock", arena->stats.miniblock_hits,
+               arena->stats.miniblock_misses);
+  for (int i = 0; i < VMA_COMMANDS; i++) {
+    print_hist(commands[i], &arena->stats.commands[i]);
+  }
+  for (int i = 0; i < VMA_PHASES; i++) {
+    print_hist(phases[i], &arena->stats.phases[i]);
+  }
+#else
+  fprintf(out_file, "Statistics were disabled at compile time.\n");
+#endif
+}
+void show_error(int nr) {
+  for (int i = 0; i <= nr; i++) {
+    fprintf(out_file, "Invalid command. Please try again.\n");
   }
 }
-miniblock_t* remove_miniblock(block_t* block, unsigned int n) {
-  miniblock_list* list = (miniblock_list*)block->miniblock_list;
-  miniblock_t* aux;
-  if (list->size == 1) {
-    aux = list->head;
-    list->head = NULL;
-  } else if (n == 0) {
-    aux = list->head;
-    list->head = list->head->next;
-    block->start_address = list->head->start_address;
-  } else if (n >= list->size - 1) {
-    aux = list->last;
-    list->last->prev->next = NULL;
-    list->last = list->last->prev;
 
+// Cu jurnalul pornit, fereastra primește doar ce a sosit deja (fread ar
+// aștepta una întreagă), iar grupul curent e scris înainte ca citirea să
+// aștepte date: o sesiune care tace nu ține comenzi doar în memorie. stdin
+// e atunci fără buffer, deci descriptorul vede tot ce n-a fost citit.
+int journal_fill(batch_reader* reader, size_t need) {
+  int fd = fileno(reader->in);
+  while (reader->len < need) {
+    struct pollfd ready = {fd, POLLIN, 0};
+    if (journal.ops != 0 && poll(&ready, 1, 0) == 0) {
+      journal_commit();
+    }
+    ssize_t got =
+        read(fd, reader->data + reader->len, BATCH_SIZE - reader->len);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      break;
+    }
+    reader->len += got;
+  }
+  return reader->len >= need;
+}
+// Asigură cel puțin need octeți necitiți în fereastra cititorului.
+int batch_fill(batch_reader* reader, size_t need) {
+  if (reader->len - reader->pos >= need) {
+    return 1;
+  }
+  memmove(reader->data, reader->data + reader->pos, reader->len - reader->pos);
+  reader->len -= reader->pos;
+  reader->pos = 0;
+  if (journal.fd >= 0) {
+    return journal_fill(reader, need);
+  }
+  reader->len += fread(reader->data + reader->len, 1, BATCH_SIZE - reader->len,
+                       reader->in);
+  return reader->len >= need;
+}
+// READV/WRITEV pot avea oricâte segmente, deci linia e citită din src și nu
+// din bufferul de comandă de lungime fixă.
+void vector_command(arena_t* arena, payload_source* src, int write) {
+  static segment_buf segments;
+  int8_t c;
+  if (!parse_segments(src, &segments, write ? ' ' : '\n')) {
+    show_error(0);
+  } else if (write) {
+    writev_command(arena, &segments, src);
   } else {
-    miniblock_t* curr = list->head;
-    for (unsigned int i = 0; i < n - 1; i++) {
-      curr = curr->next;
+    readv_command(arena, &segments);
+  }
+  // Restul liniei nu face parte din comandă.
+  while (src->last != '\n' && read_payload(src, &c, 1) == 1) {
+  }
+}
+// Operandul de 8 octeți care urmează după înregistrare.
+int read_operand(batch_reader* reader, uint64_t* value) {
+  if (!batch_fill(reader, sizeof(*value))) {
+    return 0;
+  }
+  memcpy(value, reader->data + reader->pos, sizeof(*value));
+  reader->pos += sizeof(*value);
+  return 1;
+}
+// Consumă n octeți din urmă; 0 dacă urma se termină înainte.
+int skip_bytes(batch_reader* reader, uint64_t n) {
+  while (n > 0) {
+    size_t part = n < BATCH_SIZE ? n : BATCH_SIZE;
+    if (!batch_fill(reader, part)) {
+      reader->pos = reader->len;
+      return 0;
     }
-    aux = curr->next;
-    curr->next = aux->next;
-    aux->next->prev = aux->prev;
+    reader->pos += part;
+    n -= part;
   }
-  list->size--;
-  block->size -= aux->size;
-  return aux;
+  return 1;
 }
-
-miniblock_t* split_block(list_t* list, block_t* block, unsigned int i,
-                         unsigned int j) {
-  miniblock_t* curr = ((miniblock_list*)block->miniblock_list)->head;
-  for (unsigned int k = 0; k < i - 1; k++) {
-    curr = curr->next;
+// Payload-ul și operanzii unei comenzi respinse sunt consumați, ca
+// următoarea înregistrare să fie citită de unde începe.
+void skip_payload(batch_reader* reader, const command_record* record) {
+  uint64_t value, total = 0;
+  switch (record->opcode) {
+    case OP_WRITE:
+      skip_bytes(reader, record->size);
+      break;
+    case OP_READV:
+    case OP_WRITEV:
+      for (uint64_t i = 0; i < record->size; i++) {
+        uint64_t pair[2];
+        if (!batch_fill(reader, sizeof(pair))) {
+          reader->pos = reader->len;
+          return;
+        }
+        memcpy(pair, reader->data + reader->pos, sizeof(pair));
+        reader->pos += sizeof(pair);
+        total += pair[1];
+      }
+      if (record->opcode == OP_WRITEV) {
+        skip_bytes(reader, total);
+      }
+      break;
+    case OP_MEMSET:
+    case OP_MEMMOVE:
+      read_operand(reader, &value);
+      break;
+    case OP_FIND:
+      if (read_operand(reader, &value)) {
+        skip_bytes(reader, value);
+      }
+      break;
   }
-  miniblock_t* aux = curr->next;
-  uint64_t start_address = aux->next->start_address;
-  size_t size = 0;
-  unsigned int no = 0;
-  curr = curr->next->next;
-  while (curr->next != NULL) {
-    size += curr->size;
-    curr = curr->next;
-    no++;
-  }
-  size += curr->size;
-  no++;
-  add_block(list, start_address, size, j + 1);
-  ((miniblock_list*)block->next->miniblock_list)->head = aux->next;
-  ((miniblock_list*)block->next->miniblock_list)->last = curr;
-  ((miniblock_list*)block->next->miniblock_list)->size = no;
-  miniblock_t* erase = remove_miniblock(block, i);
-  ((miniblock_list*)block->miniblock_list)->last = erase->prev;
-  ((miniblock_list*)block->miniblock_list)->last->next = NULL;
-  ((miniblock_list*)block->miniblock_list)->size -= no;
-  block->size -= size;
-  return erase;
-}
-void free_block(arena_t* arena, const uint64_t start_address) {
-  list_t* list = arena->alloc_list;
-  block_t* curr = list->head;
-  miniblock_t* aux = NULL;
-  block_t* aux2 = NULL;
-  unsigned int j = 0;
-  while (curr != NULL) {
-    if (start_address >= curr->start_address &&
-        start_address <= (curr->start_address + curr->size)) {
-      miniblock_t* currm = ((miniblock_list*)curr->miniblock_list)->head;
-      unsigned int i = 0;
-      while (currm != NULL) {
-        if (currm->start_address == start_address) {
-          arena->free_size += currm->size;
-          if (i > 0 && i < ((miniblock_list*)curr->miniblock_list)->size - 1) {
-            aux = split_block(list, curr, i, j);
-          } else if (((miniblock_list*)curr->miniblock_list)->size == 1) {
-            aux = remove_miniblock(curr, i);
-            aux2 = remove_block(list, j);
-          } else {
-            aux = remove_miniblock(curr, i);
-          }
-          arena->no_miniblocks--;
+}
+int read_segment_records(batch_reader* reader, segment_buf* segments,
+                         uint64_t count) {
+  segments->count = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t pair[2];
+    if (!batch_fill(reader, sizeof(pair))) {
+      return 0;
+    }
+    memcpy(pair, reader->data + reader->pos, sizeof(pair));
+    reader->pos += sizeof(pair);
+    if (!segments_push(segments, pair[0], pair[1])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+void run_binary(FILE* in, arena_table* table) {
+  batch_reader reader = {in, malloc(BATCH_SIZE), 0, 0};
+  segment_buf segments = {NULL, 0, 0};
+  char path[PATH_SIZE];
+  command_record record;
+  while (batch_fill(&reader, sizeof(record))) {
+    memcpy(&record, reader.data + reader.pos, sizeof(record));
+    reader.pos += sizeof(record);
+    arena_t* arena = table->current->arena;
+    if (record.opcode == OP_SAVE || record.opcode == OP_LOAD ||
+        record.opcode == OP_USE) {
+      if (record.size >= PATH_SIZE || !batch_fill(&reader, record.size)) {
+        // Calea prea lungă e consumată, ca urma să rămână aliniată.
+        skip_bytes(&reader, record.size);
+        show_error(0);
+        continue;
+      }
+      memcpy(path, reader.data + reader.pos, record.size);
+      path[record.size] = '\0';
+      reader.pos += record.size;
+    }
+    if (arena == NULL && record.opcode != OP_ALLOC_ARENA &&
+        record.opcode != OP_LOAD && record.opcode != OP_USE &&
+        record.opcode != OP_COMMIT) {
+      skip_payload(&reader, &record);
+      show_error(0);
+      continue;
+    }
+    switch (record.opcode) {
+      case OP_ALLOC_ARENA:
+        alloc_arena_command(table, record.address);
+        break;
+      case OP_USE:
+        if (!use_command(table, path)) {
+          show_error(0);
+        } else if (table->current->out != NULL) {
+          out_file = table->current->out;
+        }
+        break;
+      case OP_ALLOC_BLOCK:
+        alloc_command(arena, record.address, record.size);
+        break;
+      case OP_FREE_BLOCK:
+        free_command(arena, record.address);
+        break;
+      case OP_WRITE: {
+        // Payload-ul deja citit în fereastră se copiază de acolo, restul
+        // este citit direct în arenă.
+        uint64_t buffered = reader.len - reader.pos;
+        payload_source src = {reader.data + reader.pos, buffered, in, EOF,
+                              NULL};
+        write_command(arena, record.address, record.size, &src);
+        reader.pos += buffered - src.prefix_size;
+        break;
+      }
+      case OP_READ:
+        read_command(arena, record.address, record.size);
+        break;
+      case OP_PMAP:
+        pmap(arena);
+        break;
+      case OP_DEALLOC_ARENA:
+        dealloc_command(table);
+        break;
+      case OP_CLONE_ARENA:
+        clone_command(table);
+        break;
+      case OP_STATS:
+        stats(arena);
+        break;
+      case OP_MPROTECT:
+        mprotect_command(arena, record.address, record.size);
+        break;
+      case OP_READV:
+        if (!read_segment_records(&reader, &segments, record.size)) {
+          show_error(0);
+          break;
+        }
+        readv_command(arena, &segments);
+        break;
+      case OP_WRITEV: {
+        if (!read_segment_records(&reader, &segments, record.size)) {
+          show_error(0);
+          break;
+        }
+        uint64_t buffered = reader.len - reader.pos;
+        payload_source src = {reader.data + reader.pos, buffered, in, EOF,
+                              NULL};
+        writev_command(arena, &segments, &src);
+        reader.pos += buffered - src.prefix_size;
+        break;
+      }
+      case OP_SAVE:
+        save_command(arena, path);
+        break;
+      case OP_LOAD:
+        load_command(table, path);
+        break;
+      case OP_COMPACT:
+        if (record.address == 0) {
+          compact_command(arena);
+        } else if (record.address == 1 && record.size <= 100) {
+          compact_threshold = record.size;
+        } else {
+          show_error(0);
+          break;
+        }
+        journal_add(OP_COMPACT, record.address, record.size, NULL, 0);
+        break;
+      case OP_COMMIT:
+        break;
+      case OP_COMPRESS:
+        compress_command(arena, record.address);
+        break;
+      case OP_MEMSET: {
+        uint64_t value;
+        if (!read_operand(&reader, &value) || value > UINT8_MAX) {
+          show_error(0);
+          break;
         }
-        currm = currm->next;
-        i++;
+        memset_command(arena, record.address, record.size, value);
+        break;
       }
+      case OP_MEMMOVE: {
+        uint64_t src;
+        if (!read_operand(&reader, &src)) {
+          show_error(0);
+          break;
+        }
+        memmove_command(arena, record.address, src, record.size);
+        break;
+      }
+      case OP_FIND: {
+        // Pattern-ul e folosit direct din fereastra citită.
+        uint64_t length;
+        if (!read_operand(&reader, &length)) {
+          show_error(0);
+          break;
+        }
+        if (length > BATCH_SIZE || !batch_fill(&reader, length)) {
+          skip_bytes(&reader, length);
+          show_error(0);
+          break;
+        }
+        find_command(arena, record.address, record.size,
+                     (const int8_t*)reader.data + reader.pos, length);
+        reader.pos += length;
+        break;
+      }
+      case OP_ALLOC_ANY:
+        if (record.address > VMA_FIT_NEXT) {
+          show_error(0);
+          break;
+        }
+        alloc_any_command(arena, record.size, record.address);
+        break;
+      default:
+        show_error(0);
     }
-    curr = curr->next;
-    j++;
   }
-  if (aux != NULL) {
-    free_mem_miniblock(aux);
+  free(reader.data);
+  free(segments.data);
+}
+// Lungimea părții valide a jurnalului: grupurile întregi, cu suma de control
+// corectă, până la primul grup rupt.
+uint64_t journal_scan(int fd) {
+  const command_record empty = {0};
+  command_record header;
+  uint64_t end = 0;
+  while (pread(fd, &header, sizeof(header), end) == (ssize_t)sizeof(header) &&
+         header.opcode == OP_COMMIT &&
+         memcmp(header.reserved, empty.reserved, sizeof(empty.reserved)) == 0) {
+    journal_sum sum;
+    uint64_t pos = end + sizeof(header), left = header.size;
+    sum_init(&sum);
+    while (left > 0) {
+      ssize_t got = pread(fd, journal.data,
+                          left < JOURNAL_BUFFER ? left : JOURNAL_BUFFER, pos);
+      if (got <= 0) {
+        break;
+      }
+      sum_add(&sum, journal.data, got);
+      pos += got;
+      left -= got;
+    }
+    if (left > 0 || sum_value(&sum) != header.address) {
+      break;
+    }
+    end = pos;
+  }
+  return end;
+}
+// Reia comenzile din jurnal, cu ieșirea aruncată, apoi îl deschide pentru
+// comenzile noi. Ca la orice pornire, numele curent redevine DEFAULT_ARENA.
+int journal_open(const char* path, arena_table* table) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  journal.data = malloc(JOURNAL_BUFFER);
+  if (fd < 0 || journal.data == NULL) {
+    return 0;
+  }
+  uint64_t end = journal_scan(fd);
+  if (ftruncate(fd, end) != 0 || lseek(fd, end, SEEK_SET) < 0) {
+    close(fd);
+    return 0;
+  }
+  FILE* in = fopen(path, "rb");
+  if (in == NULL) {
+    close(fd);
+    return 0;
+  }
+  fflush(stdout);
+  int out = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  if (out >= 0 && null >= 0) {
+    dup2(null, STDOUT_FILENO);
+    run_binary(in, table);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+  }
+  if (out >= 0) {
+    close(out);
+  }
+  if (null >= 0) {
+    close(null);
+  }
+  fclose(in);
+  if (out < 0 || null < 0) {
+    close(fd);
+    return 0;
+  }
+  journal.fd = fd;
+  journal.offset = end;
+  return strcmp(table->current->name, DEFAULT_ARENA) == 0 ||
+         use_command(table, DEFAULT_ARENA);
+}
+// O citire din in nu s-ar bloca acum: stdio are date deja citite, au
+// sosit date în descriptor sau intrarea s-a terminat.
+int input_ready(FILE* in) {
+  int fd = fileno(in);
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    return 0;
+  }
+  int c = getc(in);
+  int ready = c != EOF || feof(in);
+  if (c != EOF) {
+    ungetc(c, in);
   } else {
-    printf("Invalid address for free.\n");
+    clearerr(in);
   }
-  if (aux2 != NULL) {
-    free_mem_block(aux2);
+  fcntl(fd, F_SETFL, flags);
+  return ready;
+}
+void journal_close(void) {
+  journal_commit();
+  if (journal.fd >= 0) {
+    close(journal.fd);
   }
+  free(journal.data);
 }
-void write_in_more_miniblocks(miniblock_t* miniblock, uint64_t size,
-                              int8_t* data) {
-  long unsigned int count = 0;
-  while (count < size && miniblock != NULL) {
-    if (size - count > miniblock->size) {
-      memcpy(miniblock->rw_buffer, data + count, miniblock->size);
-      count += miniblock->size;
-    } else {
-      memcpy(miniblock->rw_buffer, data + count, size - count);
-      count += size - count;
+// Reluarea în paralel a unei urme binare cu mai multe arene (--parallel).
+// Urma e împărțită după numele arenei în câte un shard, cu înregistrările
+// numelui în ordinea lor, iar shard-urile sunt reluate independent, fiecare
+// cu tabela, domeniul și ieșirea lui. Ieșirile sunt scrise la final, în
+// ordinea primei apariții a numelor. Lungimea fiecărei înregistrări rezultă
+// doar din ea însăși, deci împărțirea nu depinde de execuție. Numele nu sunt
+// independente dacă urma schimbă pragul COMPACT AUTO, comun tuturor, sau
+// încarcă snapshot-uri pe care tot ea le salvează; atunci urma e reluată
+// în ordinea ei, cu ieșirea fiecărui nume tot în shard-ul lui.
+typedef struct replay_shard {
+  char name[NAME_SIZE];
+  out_buf input;  // înregistrările numelui
+  char* output;
+  size_t output_size;
+  int failed;
+} replay_shard;
+typedef struct replay_trace {
+  replay_shard* shards;  // în ordinea primei apariții
+  size_t count, capacity;
+  size_t* index;  // adresare deschisă după nume: indicele shard-ului + 1
+  size_t index_capacity;
+  int compacts, saves, loads;  // înregistrări care leagă numele între ele
+} replay_trace;
+// Shard-ul numelui, creat dacă nu există; SIZE_MAX dacă memoria nu ajunge.
+size_t replay_find(replay_trace* trace, const char* name) {
+  if (2 * (trace->count + 1) > trace->index_capacity) {
+    size_t capacity =
+        trace->index_capacity != 0 ? 2 * trace->index_capacity : 16;
+    size_t* index = calloc(capacity, sizeof(size_t));
+    if (index == NULL) {
+      return SIZE_MAX;
     }
-
-    miniblock = miniblock->next;
-  }
-}
-void write(arena_t* arena, const uint64_t address, const uint64_t size,
-           int8_t* data) {
-  list_t* list = arena->alloc_list;
-  block_t* curr = list->head;
-  int ok = 0;
-  while (curr != NULL) {
-    if (address >= curr->start_address &&
-        address <= (curr->start_address + curr->size)) {
-      miniblock_t* currm = ((miniblock_list*)curr->miniblock_list)->head;
-      while (currm != NULL) {
-        if (address == currm->start_address) {
-          if (currm->size < size) {
-            if (currm->next == NULL) {
-              printf(
-                  "Warning: size was bigger than the block size. Writing "
-                  "%d "
-                  "characters.\n",
-                  (int)currm->size);
-              data[currm->size] = '\0';
-              ok = 1;
-              memcpy(currm->rw_buffer, data, currm->size);
-              break;
-            } else {
-              ok = 1;
-              write_in_more_miniblocks(currm, size, data);
-            }
-          } else {
-            ok = 1;
-            memcpy(currm->rw_buffer, data, size);
-          }
-        } else if (address > currm->start_address &&
-                   address < (currm->start_address + currm->size)) {
-          if (address + size > currm->start_address + currm->size) {
-            printf(
-                "Warning: size was bigger than the block size. Writing "
-                "%lu "
-                "characters.\n",
-                (currm->start_address + currm->size - address));
-            uint64_t indx = currm->start_address + currm->size - address;
-            data[indx] = '\0';
-          }
-          ok = 1;
-          memcpy(currm->rw_buffer, data, size);
-        }
-        currm = currm->next;
+    for (size_t i = 0; i < trace->count; i++) {
+      size_t j = name_hash(trace->shards[i].name) & (capacity - 1);
+      while (index[j] != 0) {
+        j = (j + 1) & (capacity - 1);
       }
+      index[j] = i + 1;
     }
-    curr = curr->next;
+    free(trace->index);
+    trace->index = index;
+    trace->index_capacity = capacity;
+  }
+  size_t j = name_hash(name) & (trace->index_capacity - 1);
+  while (trace->index[j] != 0) {
+    if (strcmp(trace->shards[trace->index[j] - 1].name, name) == 0) {
+      return trace->index[j] - 1;
+    }
+    j = (j + 1) & (trace->index_capacity - 1);
   }
-  if (ok == 0) {
-    printf("Invalid address for write.\n");
+  if (trace->count == trace->capacity) {
+    size_t capacity = trace->capacity != 0 ? 2 * trace->capacity : 16;
+    replay_shard* shards =
+        realloc(trace->shards, capacity * sizeof(replay_shard));
+    if (shards == NULL) {
+      return SIZE_MAX;
+    }
+    trace->shards = shards;
+    trace->capacity = capacity;
   }
+  replay_shard* shard = &trace->shards[trace->count];
+  memset(shard, 0, sizeof(*shard));
+  strcpy(shard->name, name);
+  trace->index[j] = ++trace->count;
+  return trace->count - 1;
 }
-void read_from_more_miniblocks(miniblock_t* miniblock, uint64_t size) {
-  long unsigned int count = 0;
-  while (count < size && miniblock != NULL) {
-    if (size - count > miniblock->size) {
-      for (long unsigned int i = 0; i < miniblock->size; i++) {
-        printf("%c", *((char*)miniblock->rw_buffer + i));
-      }
-      count += miniblock->size;
-    } else {
-      for (long unsigned int i = 0; i < size - count; i++) {
-        printf("%c", *((char*)miniblock->rw_buffer + i));
-      }
-      count += miniblock->size;
-    }
-    miniblock = miniblock->next;
-  }
-  printf("\n");
-}
-void read(arena_t* arena, uint64_t address, uint64_t size) {
-  list_t* list = arena->alloc_list;
-  block_t* curr = list->head;
-  int ok = 0;
-  while (curr != NULL) {
-    if (address >= curr->start_address &&
-        address <= (curr->start_address + curr->size)) {
-      miniblock_t* currm = ((miniblock_list*)curr->miniblock_list)->head;
-      while (currm != NULL) {
-        if (address == currm->start_address) {
-          if (currm->size < size) {
-            if (currm->next == NULL) {
-              printf(
-                  "Warning: size was bigger than the block size. Reading %lu "
-                  "characters.\n",
-                  currm->size);
-
-              ok = 1;
-              for (long unsigned int i = 0; i < currm->size; i++) {
-                printf("%c", *((char*)currm->rw_buffer + i));
-              }
-              printf("\n");
-            } else {
-              ok = 1;
-              read_from_more_miniblocks(currm, size);
-            }
-          } else {
-            ok = 1;
-            for (long unsigned int i = 0; i < size; i++) {
-              printf("%c", *((char*)currm->rw_buffer + i));
-            }
-            printf("\n");
-          }
-        } else if (address > currm->start_address &&
-                   address < currm->start_address + currm->size) {
-          ok = 1;
-          for (long unsigned int i = address - currm->start_address; i <= size;
-               i++)
-            printf("%c", *((char*)currm->rw_buffer + i));
-          printf("\n");
+// Mută n octeți din urmă în input. Dacă urma se termină înainte, restul ei
+// ajunge tot în input, unde e citit ca de run_binary, și întoarce 0.
+int replay_copy(batch_reader* reader, out_buf* input, uint64_t n) {
+  while (n > 0) {
+    size_t part = n < BATCH_SIZE ? n : BATCH_SIZE;
+    if (!batch_fill(reader, part)) {
+      out_append(input, reader->data + reader->pos, reader->len - reader->pos);
+      reader->pos = reader->len;
+      return 0;
+    }
+    out_append(input, reader->data + reader->pos, part);
+    reader->pos += part;
+    n -= part;
+  }
+  return 1;
+}
+// Payload-ul și operanzii de după înregistrare, mutați în input ca de
+// skip_payload; 0 la sfârșitul urmei.
+int replay_payload(batch_reader* reader, const command_record* record,
+                   out_buf* input) {
+  switch (record->opcode) {
+    case OP_WRITE:
+      return replay_copy(reader, input, record->size);
+    case OP_READV:
+    case OP_WRITEV: {
+      uint64_t total = 0;
+      for (uint64_t i = 0; i < record->size; i++) {
+        uint64_t pair[2];
+        if (!batch_fill(reader, sizeof(pair))) {
+          return replay_copy(reader, input, sizeof(pair));
         }
-        currm = currm->next;
+        memcpy(pair, reader->data + reader->pos, sizeof(pair));
+        total += pair[1];
+        replay_copy(reader, input, sizeof(pair));
       }
+      return record->opcode == OP_READV || replay_copy(reader, input, total);
     }
-    curr = curr->next;
+    case OP_MEMSET:
+    case OP_MEMMOVE:
+      return replay_copy(reader, input, sizeof(uint64_t));
+    case OP_FIND: {
+      uint64_t length;
+      if (!batch_fill(reader, sizeof(length))) {
+        return replay_copy(reader, input, sizeof(length));
+      }
+      memcpy(&length, reader->data + reader->pos, sizeof(length));
+      replay_copy(reader, input, sizeof(length));
+      return replay_copy(reader, input, length);
+    }
+    default:
+      return 1;
+  }
+}
+// Împarte urma din in după numele arenei; 0 dacă memoria nu ajunge.
+int replay_split(FILE* in, replay_trace* trace) {
+  batch_reader reader = {in, malloc(BATCH_SIZE), 0, 0};
+  size_t current = replay_find(trace, DEFAULT_ARENA);
+  command_record record;
+  if (reader.data == NULL || current == SIZE_MAX) {
+    free(reader.data);
+    return 0;
   }
-  if (ok == 0) {
-    printf("Invalid address for read.\n");
+  while (batch_fill(&reader, sizeof(record))) {
+    memcpy(&record, reader.data + reader.pos, sizeof(record));
+    reader.pos += sizeof(record);
+    if (record.opcode == OP_COMMIT) {
+      continue;
+    }
+    if (record.opcode == OP_USE && record.size < NAME_SIZE &&
+        batch_fill(&reader, record.size)) {
+      char name[NAME_SIZE];
+      memcpy(name, reader.data + reader.pos, record.size);
+      name[record.size] = '\0';
+      reader.pos += record.size;
+      current = replay_find(trace, name);
+      if (current == SIZE_MAX) {
+        free(reader.data);
+        return 0;
+      }
+      continue;
+    }
+    replay_shard* shard = &trace->shards[current];
+    out_append(&shard->input, (const char*)&record, sizeof(record));
+    trace->compacts += record.opcode == OP_COMPACT && record.address == 1;
+    // O cale prea lungă e copiată și ea, iar shard-ul respinge înregistrarea.
+    trace->saves += record.opcode == OP_SAVE && record.size < PATH_SIZE;
+    trace->loads += record.opcode == OP_LOAD && record.size < PATH_SIZE;
+    if (record.opcode == OP_SAVE || record.opcode == OP_LOAD ||
+        record.opcode == OP_USE) {
+      if (!replay_copy(&reader, &shard->input, record.size)) {
+        break;
+      }
+    } else if (!replay_payload(&reader, &record, &shard->input)) {
+      break;
+    }
   }
+  free(reader.data);
+  return 1;
 }
-void pmap(const arena_t* arena) {
-  printf("Total memory: 0x%lX bytes\n", (arena->arena_size));
-  printf("Free memory: 0x%lX bytes\n", arena->free_size);
-  printf("Number of allocated blocks: %d\n", arena->alloc_list->size);
-  printf("Number of allocated miniblocks: %d\n", arena->no_miniblocks);
-  block_t* curr = arena->alloc_list->head;
-
-  for (unsigned int i = 1; i <= arena->alloc_list->size; i++) {
-    printf("\nBlock %d begin\n", i);
-    printf("Zone: 0x%lX - 0x%lX\n", curr->start_address,
-           (curr->start_address + curr->size));
-    miniblock_t* currm = ((miniblock_list*)curr->miniblock_list)->head;
-    for (unsigned int j = 1; j <= ((miniblock_list*)curr->miniblock_list)->size;
-         j++) {
-      printf("Miniblock %d:", j);
-      printf("\t\t0x%lX\t\t-\t\t0x%lX\t\t", currm->start_address,
-             (currm->start_address + currm->size));
-      printf("| RW-\n");
-      currm = currm->next;
+// Reia un shard într-o tabelă proprie, cu ieșirea într-un buffer.
+void replay_shard_run(replay_shard* shard) {
+  arena_table table = {NULL, 0, 0, 0, NULL, vma_domain_create()};
+  FILE* in = fmemopen(shard->input.data, shard->input.size, "r");
+  out_file = open_memstream(&shard->output, &shard->output_size);
+  compact_threshold = 0;
+  table.current = find_slot(&table, shard->name);
+  if (in != NULL && out_file != NULL && table.current != NULL) {
+    run_binary(in, &table);
+    // Arenele rămase sunt eliberate, ca memoria să nu crească de la un
+    // shard la altul.
+    for (size_t i = 0; i < table.capacity; i++) {
+      table.current = &table.slots[i];
+      drop_slot(&table);
     }
-    printf("Block %d end\n", i);
-    curr = curr->next;
+  } else {
+    shard->failed = 1;
   }
+  if (in != NULL) {
+    fclose(in);
+  }
+  if (out_file != NULL) {
+    fclose(out_file);
+  }
+  out_file = stdout;
+  free_table(&table);
+  free(shard->input.data);
+  shard->input.data = NULL;
 }
-void dealloc_arena(arena_t* arena) {
-  block_t* curr = arena->alloc_list->head;
-  block_t* aux;
-  for (unsigned int i = 0; i < arena->alloc_list->size; i++) {
-    miniblock_t* currm = ((miniblock_list*)curr->miniblock_list)->head;
-    miniblock_t* auxm;
-    for (unsigned int j = 0; j < ((miniblock_list*)curr->miniblock_list)->size;
-         j++) {
-      auxm = currm;
-      currm = currm->next;
-      free_mem_miniblock(auxm);
+// Reia toată urma, în ordinea ei, într-o singură tabelă; fiecare nume își
+// scrie ieșirea în bufferul shard-ului lui.
+void replay_serial(replay_trace* trace, const out_buf* whole) {
+  arena_table table = {NULL, 0, 0, 0, NULL, vma_domain_create()};
+  FILE* in = fmemopen(whole->data, whole->size, "r");
+  int ok = in != NULL;
+  for (size_t i = 0; i < trace->count; i++) {
+    replay_shard* shard = &trace->shards[i];
+    arena_slot* slot = ok ? find_slot(&table, shard->name) : NULL;
+    if (slot != NULL) {
+      slot->out = open_memstream(&shard->output, &shard->output_size);
     }
-    aux = curr;
-    curr = curr->next;
-    free_mem_block(aux);
+    if (slot == NULL || slot->out == NULL) {
+      shard->failed = 1;
+      ok = 0;
+    }
+  }
+  if (ok) {
+    table.current = find_slot(&table, DEFAULT_ARENA);
+    out_file = table.current->out;
+    run_binary(in, &table);
   }
-  free(arena->alloc_list);
-  free(arena);
+  for (size_t i = 0; i < table.capacity; i++) {
+    table.current = &table.slots[i];
+    drop_slot(&table);
+    if (table.current->out != NULL) {
+      fclose(table.current->out);
+    }
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+  out_file = stdout;
+  free_table(&table);
 }
-void show_error(int nr) {
-  for (int i = 0; i <= nr; i++) {
-    printf("Invalid command. Please try again.\n");
+#ifdef VMA_THREADS
+// Fiecare thread are o coadă de shard-uri, pe care o golește de la cel mai
+// mare; rămas fără, fură cel mai mic shard din coada altui thread.
+typedef struct replay_queue {
+  pthread_mutex_t lock;
+  size_t* tasks;
+  size_t head, tail;
+} replay_queue;
+typedef struct replay_pool {
+  replay_trace* trace;
+  replay_queue* queues;
+  unsigned int workers;
+} replay_pool;
+typedef struct replay_worker {
+  replay_pool* pool;
+  unsigned int self;
+} replay_worker;
+typedef struct replay_task {
+  size_t size, shard;
+} replay_task;
+int compare_tasks(const void* a, const void* b) {
+  const replay_task* x = a;
+  const replay_task* y = b;
+  if (x->size != y->size) {
+    return x->size > y->size ? -1 : 1;
   }
+  return x->shard < y->shard ? -1 : x->shard > y->shard;
 }
-
-int main() {
+int replay_take(replay_pool* pool, unsigned int self, size_t* shard) {
+  for (unsigned int k = 0; k < pool->workers; k++) {
+    replay_queue* queue = &pool->queues[(self + k) % pool->workers];
+    int found = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail) {
+      *shard = k == 0 ? queue->tasks[queue->head++]
+                      : queue->tasks[--queue->tail];
+      found = 1;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (found) {
+      return 1;
+    }
+  }
+  return 0;
+}
+void* replay_work(void* arg) {
+  replay_worker* worker = arg;
+  size_t shard;
+  while (replay_take(worker->pool, worker->self, &shard)) {
+    replay_shard_run(&worker->pool->trace->shards[shard]);
+  }
+  // Bufferele comenzilor dispar odată cu thread-ul care le-a folosit.
+  if (worker->self != 0) {
+    free(command_out.data);
+    free(command_payload.data);
+  }
+  return NULL;
+}
+// Thread-ul principal e și el unul din cele threads; dacă unele nu pot fi
+// pornite, cozile lor sunt golite de celelalte.
+int replay_run(replay_trace* trace, unsigned int threads) {
+  replay_task* tasks = malloc(trace->count * sizeof(replay_task));
+  size_t count = 0;
+  for (size_t i = 0; tasks != NULL && i < trace->count; i++) {
+    if (trace->shards[i].input.size != 0) {
+      replay_task task = {trace->shards[i].input.size, i};
+      tasks[count++] = task;
+    }
+  }
+  if (threads > count) {
+    threads = count != 0 ? count : 1;
+  }
+  replay_pool pool = {trace, calloc(threads, sizeof(replay_queue)), threads};
+  replay_worker* workers = malloc(threads * sizeof(replay_worker));
+  pthread_t* ids = malloc(threads * sizeof(pthread_t));
+  int ok = tasks != NULL && pool.queues != NULL && workers != NULL &&
+           ids != NULL;
+  for (unsigned int i = 0; ok && i < threads; i++) {
+    pool.queues[i].tasks = malloc((count / threads + 1) * sizeof(size_t));
+    ok = pool.queues[i].tasks != NULL;
+  }
+  if (ok) {
+    qsort(tasks, count, sizeof(replay_task), compare_tasks);
+    for (unsigned int i = 0; i < threads; i++) {
+      pthread_mutex_init(&pool.queues[i].lock, NULL);
+    }
+    for (size_t i = 0; i < count; i++) {
+      replay_queue* queue = &pool.queues[i % threads];
+      queue->tasks[queue->tail++] = tasks[i].shard;
+    }
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+      workers[i].pool = &pool;
+      workers[i].self = i;
+      if (i != 0 &&
+          pthread_create(&ids[started], NULL, replay_work, &workers[i]) == 0) {
+        started++;
+      }
+    }
+    replay_work(&workers[0]);
+    for (unsigned int i = 0; i < started; i++) {
+      pthread_join(ids[i], NULL);
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+      pthread_mutex_destroy(&pool.queues[i].lock);
+    }
+  }
+  for (unsigned int i = 0; pool.queues != NULL && i < threads; i++) {
+    free(pool.queues[i].tasks);
+  }
+  free(pool.queues);
+  free(workers);
+  free(ids);
+  free(tasks);
+  return ok;
+}
+#else
+int replay_run(replay_trace* trace, unsigned int threads) {
+  (void)threads;
+  for (size_t i = 0; i < trace->count; i++) {
+    if (trace->shards[i].input.size != 0) {
+      replay_shard_run(&trace->shards[i]);
+    }
+  }
+  return 1;
+}
+#endif
+// Reia urma binară din in pe threads thread-uri (0: câte procesoare sunt)
+// și scrie ieșirile arenelor; 0 dacă urma nu a putut fi reluată.
+int replay_parallel(FILE* in, unsigned int threads) {
+  replay_trace trace = {NULL, 0, 0, NULL, 0, 0, 0, 0};
+  out_buf whole = {NULL, 0, 0};
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+  // Urma e citită întreagă: dacă numele nu sunt independente, e reluată
+  // din nou, în ordinea ei.
+  for (size_t got = 1; got != 0; whole.size += got) {
+    out_reserve(&whole, BATCH_SIZE);
+    got = fread(whole.data + whole.size, 1, BATCH_SIZE, in);
+  }
+  FILE* trace_in = fmemopen(whole.data, whole.size, "r");
+  int ok = trace_in != NULL && replay_split(trace_in, &trace);
+  if (trace_in != NULL) {
+    fclose(trace_in);
+  }
+  if (ok && (trace.compacts != 0 || (trace.saves != 0 && trace.loads != 0))) {
+    for (size_t i = 0; i < trace.count; i++) {
+      free(trace.shards[i].input.data);
+      trace.shards[i].input.data = NULL;
+    }
+    replay_serial(&trace, &whole);
+  } else if (ok) {
+    free(whole.data);
+    whole.data = NULL;
+    ok = replay_run(&trace, threads);
+  }
+  free(whole.data);
+  if (!ok) {
+    fprintf(stderr, "Failed to replay the trace\n");
+  }
+  for (size_t i = 0; ok && i < trace.count; i++) {
+    if (trace.shards[i].failed) {
+      fprintf(stderr, "Failed to replay the arena %s\n", trace.shards[i].name);
+      ok = 0;
+    }
+  }
+  for (size_t i = 0; i < trace.count; i++) {
+    replay_shard* shard = &trace.shards[i];
+    if (ok) {
+      fwrite(shard->output, 1, shard->output_size, stdout);
+    }
+    free(shard->input.data);
+    free(shard->output);
+  }
+  free(trace.shards);
+  free(trace.index);
+  return ok;
+}
+int main(int argc, char* argv[]) {
+  int binary = 0, loaded = 0, parallel = 0;
+  unsigned int threads = 0;
+  const char* journal_path = NULL;
+  arena_table table = {NULL, 0, 0, 0, NULL, vma_domain_create()};
+  out_file = stdout;
+  if (!use_command(&table, DEFAULT_ARENA)) {
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--binary") == 0) {
+      binary = 1;
+    } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+      // Pornire din snapshot, în loc de reluarea comenzilor.
+      arena_t* arena;
+      if (vma_load_in(table.domain, argv[++i], &arena) != VMA_OK) {
+        fprintf(stderr, "Failed to load the arena\n");
+        return 1;
+      }
+      drop_slot(&table);
+      set_arena(&table, arena);
+      loaded = 1;
+    } else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+      // Comenzile din jurnal se aplică după snapshot-ul dat cu --load.
+      journal_path = argv[++i];
+    } else if (strcmp(argv[i], "--group-commit") == 0 && i + 2 < argc) {
+      journal.group_ops = atol(argv[++i]);
+      journal.group_ns = atol(argv[++i]) * 1000ull;
+    } else if (strcmp(argv[i], "--parallel") == 0 && i + 1 < argc) {
+      parallel = 1;
+      threads = atol(argv[++i]);
+    } else {
+      binary = -1;
+      break;
+    }
+  }
+  // Reluarea în paralel pornește de la arene goale și nu scrie jurnal.
+  if (binary < 0 ||
+      (parallel && (!binary || loaded || journal_path != NULL))) {
+    fprintf(stderr,
+            "Usage: %s [--binary] [--load <snapshot>] [--journal <path>] "
+            "[--group-commit <ops> <us>] [--parallel <threads>]\n",
+            argv[0]);
+    return 1;
+  }
+  if (parallel) {
+    int status = replay_parallel(stdin, threads) ? 0 : 1;
+    free_table(&table);
+    return status;
+  }
+  if (journal_path != NULL && !journal_open(journal_path, &table)) {
+    fprintf(stderr, "Failed to open the journal\n");
+    return 1;
+  }
+  if (binary) {
+    if (journal_path != NULL) {
+      setvbuf(stdin, NULL, _IONBF, 0);
+    }
+    run_binary(stdin, &table);
+    journal_close();
+    free_table(&table);
+    return 0;
+  }
   char command[STRING_SIZE];
   // signed char p[100];
   // char c;
@@ -614,18 +1933,52 @@ int main() {
   // signed char copy[100];
   uint64_t start_address, nr_bytes;
   size_t size;
-  arena_t* arena;
   while (1) {
     // scanf("%s", command);
-    fgets(command, 50, stdin);
+    if (journal.ops != 0 && !input_ready(stdin)) {
+      journal_commit();
+    }
+    if (fgets(command, 50, stdin) == NULL) {
+      break;
+    }
     nr = 0;
-    command[strlen(command) + 1] = '\0';
+    arena_t* arena = table.current->arena;
+    size_t length = strlen(command);
+    // Lista de permisiuni a unui MPROTECT, calea unui SAVE/LOAD și
+    // pattern-ul unui FIND pot depăși 49 de caractere.
+    if ((strncmp(command, "MPROTECT ", 9) == 0 ||
+         strncmp(command, "SAVE ", 5) == 0 ||
+         strncmp(command, "LOAD ", 5) == 0 ||
+         strncmp(command, "FIND ", 5) == 0) &&
+        command[length - 1] != '\n' &&
+        fgets(command + length, STRING_SIZE - 1 - length, stdin) != NULL) {
+      length = strlen(command);
+    }
+    command[length + 1] = '\0';
     // memcpy(copy, command, 50);
-    for (long unsigned int i = 0; i < strlen(command); i++) {
+    for (long unsigned int i = 0; i < length; i++) {
       if (command[i] == ' ') {
         nr++;
       }
     }
+    // Un nume ales cu USE nu are încă o arenă.
+    if (arena == NULL && strncmp(command, "ALLOC_ARENA ", 12) != 0 &&
+        strncmp(command, "LOAD ", 5) != 0 && strncmp(command, "USE ", 4) != 0) {
+      show_error(nr);
+      continue;
+    }
+    int vector = 0;
+    if (strncmp(command, "READV ", 6) == 0) {
+      vector = 6;
+    } else if (strncmp(command, "WRITEV ", 7) == 0) {
+      vector = 7;
+    }
+    if (vector != 0) {
+      payload_source src = {command + vector, length - vector, stdin, ' ',
+                            NULL};
+      vector_command(arena, &src, vector == 7);
+      continue;
+    }
     aux = strtok(command, " ");
     if (strcmp(command, "ALLOC_ARENA") == 0) {
       if (nr != 1) {
@@ -635,7 +1988,7 @@ int main() {
       aux = strtok(NULL, " ");
       nr_bytes = atol(aux);
       // scanf("%lu", &nr_bytes);
-      arena = alloc_arena(nr_bytes);
+      alloc_arena_command(&table, nr_bytes);
     } else if (strcmp(command, "ALLOC_BLOCK") == 0) {
       if (nr != 2) {
         show_error(nr);
@@ -644,10 +1997,28 @@ int main() {
       aux = strtok(NULL, " ");
       start_address = atol(aux);
       aux = strtok(NULL, " ");
-      size = atoi(aux);
+      size = atol(aux);
       // scanf("%lu", &start_address);
       // scanf("%lu", &size);
-      alloc_block(arena, start_address, size);
+      alloc_command(arena, start_address, size);
+    } else if (strcmp(command, "ALLOC_ANY") == 0) {
+      if (nr != 1 && nr != 2) {
+        show_error(nr);
+        continue;
+      }
+      aux = strtok(NULL, " ");
+      size = atol(aux);
+      vma_fit policy = VMA_FIT_FIRST;
+      aux = strtok(NULL, " \n");
+      if (aux != NULL && strcmp(aux, "BEST") == 0) {
+        policy = VMA_FIT_BEST;
+      } else if (aux != NULL && strcmp(aux, "NEXT") == 0) {
+        policy = VMA_FIT_NEXT;
+      } else if (aux != NULL && strcmp(aux, "FIRST") != 0) {
+        show_error(nr);
+        continue;
+      }
+      alloc_any_command(arena, size, policy);
     } else if (strcmp(command, "FREE_BLOCK") == 0) {
       if (nr != 1) {
         show_error(nr);
@@ -656,7 +2027,7 @@ int main() {
       aux = strtok(NULL, " ");
       start_address = atol(aux);
       // scanf("%lu", &start_address);
-      free_block(arena, start_address);
+      free_command(arena, start_address);
     } else if (strcmp(command, "WRITE") == 0) {
       if (nr < 3) {
         show_error(nr);
@@ -665,27 +2036,19 @@ int main() {
       aux = strtok(NULL, " ");
       start_address = atol(aux);
       aux = strtok(NULL, " ");
-      size = atoi(aux);
+      size = atol(aux);
       aux = strtok(NULL, "\0");
-
-      // scanf("%lu", &start_address);
-      // scanf("%lu", &size);
-      // scanf("%c", &c);
-      // for (long unsigned int i = 0; i < size; i++) {
-      //   scanf("%c", &p[i]);
-      // }
-      char aux2[50];
-      long unsigned int count;
-      if (strlen(aux) < size) {
-        count = strlen(aux);
-        while (count < size) {
-          fgets(aux2, 50, stdin);
-          aux2[strlen(aux2)] = '\0';
-          count += strlen(aux2);
-          strcat(aux, aux2);
-        }
+      uint64_t buffered = aux != NULL ? strlen(aux) : 0;
+      payload_source src = {aux, buffered, stdin, EOF, NULL};
+      write_command(arena, start_address, size, &src);
+      int last = src.last;
+      if (buffered > size) {
+        last = (unsigned char)aux[buffered - 1];
+      }
+      // Restul liniei de după payload nu face parte din comandă.
+      while (last != '\n' && last != EOF) {
+        last = getchar();
       }
-      write(arena, start_address, size, (signed char*)aux);
     } else if (strcmp(command, "READ") == 0) {
       if (nr != 2) {
         show_error(nr);
@@ -694,43 +2057,150 @@ int main() {
       aux = strtok(NULL, " ");
       start_address = atol(aux);
       aux = strtok(NULL, " ");
-      size = atoi(aux);
+      size = atol(aux);
       // scanf("%lu", &start_address);
       // scanf("%lu", &size);
-      read(arena, start_address, size);
+      read_command(arena, start_address, size);
     } else if (strncmp(command, "PMAP", 4) == 0) {
       if (nr != 0) {
         show_error(nr);
         continue;
       }
       pmap(arena);
-    }
-    // else if (strcmp(command, "MPROTECT") == 0) {
-    // if (nr < 2) {
-    //   show_error(nr);
-    //   continue;
-    // }
-    // aux = strtok(NULL, " ");
-    // start_address = atol(aux);
-    // aux = strtok(NULL, " ");
-    // while(aux != NULL) {
-    //   aux = startok(NULL, " ");
-    //   if(strncmp(aux, "PROT_NONE", 9) == 0) {
-    //     perm += 0;
-    //   } else
-    // }
-    // mprotect(arena, start_address, (signed char*)aux);
-    else if (strncmp(command, "DEALLOC_ARENA", 13) == 0) {
+    } else if (strncmp(command, "STATS", 5) == 0) {
       if (nr != 0) {
         show_error(nr);
         continue;
       }
-      dealloc_arena(arena);
-      break;
+      stats(arena);
+    } else if (strcmp(command, "MPROTECT") == 0) {
+      if (nr < 2) {
+        show_error(nr);
+        continue;
+      }
+      aux = strtok(NULL, " ");
+      start_address = atol(aux);
+      uint8_t perm = VMA_PROT_NONE;
+      int valid = 1;
+      for (aux = strtok(NULL, " |\n"); aux != NULL;
+           aux = strtok(NULL, " |\n")) {
+        if (strcmp(aux, "PROT_READ") == 0) {
+          perm |= VMA_PROT_READ;
+        } else if (strcmp(aux, "PROT_WRITE") == 0) {
+          perm |= VMA_PROT_WRITE;
+        } else if (strcmp(aux, "PROT_EXEC") == 0) {
+          perm |= VMA_PROT_EXEC;
+        } else if (strcmp(aux, "PROT_NONE") != 0) {
+          valid = 0;
+        }
+      }
+      if (!valid) {
+        show_error(nr);
+        continue;
+      }
+      mprotect_command(arena, start_address, perm);
+    } else if (strcmp(command, "MEMSET") == 0 ||
+               strcmp(command, "MEMMOVE") == 0) {
+      if (nr != 3) {
+        show_error(nr);
+        continue;
+      }
+      aux = strtok(NULL, " ");
+      start_address = atol(aux);
+      aux = strtok(NULL, " ");
+      uint64_t operand = atol(aux);
+      char* value = strtok(NULL, " \n");
+      if (value == NULL || strspn(value, "0123456789") != strlen(value)) {
+        show_error(nr);
+      } else if (command[3] == 'M') {
+        memmove_command(arena, start_address, operand, atol(value));
+      } else if (atol(value) > UINT8_MAX) {
+        show_error(nr);
+      } else {
+        memset_command(arena, start_address, operand, atol(value));
+      }
+    } else if (strcmp(command, "FIND") == 0) {
+      // Pattern-ul e restul liniei și poate conține spații.
+      if (nr < 3 || command[length - 1] != '\n') {
+        show_error(nr);
+        for (int c = command[length - 1]; c != '\n' && c != EOF;) {
+          c = getchar();
+        }
+        continue;
+      }
+      aux = strtok(NULL, " ");
+      start_address = atol(aux);
+      aux = strtok(NULL, " ");
+      size = atol(aux);
+      aux = strtok(NULL, "\n");
+      if (aux == NULL) {
+        show_error(nr);
+        continue;
+      }
+      find_command(arena, start_address, size, (const int8_t*)aux,
+                   strlen(aux));
+    } else if (strncmp(command, "COMPACT", 7) == 0 &&
+               (command[7] == '\n' || command[7] == ' ' ||
+                command[7] == '\0')) {
+      if (nr == 0) {
+        compact_command(arena);
+        journal_add(OP_COMPACT, 0, 0, NULL, 0);
+        continue;
+      }
+      aux = strtok(NULL, " ");
+      char* value = strtok(NULL, " \n");
+      if (nr != 2 || strcmp(aux, "AUTO") != 0 || value == NULL ||
+          strspn(value, "0123456789") != strlen(value) || atol(value) > 100) {
+        show_error(nr);
+        continue;
+      }
+      compact_threshold = atol(value);
+      journal_add(OP_COMPACT, 1, compact_threshold, NULL, 0);
+    } else if (strcmp(command, "COMPRESS") == 0) {
+      aux = strtok(NULL, " \n");
+      if (nr != 1 || aux == NULL || strspn(aux, "0123456789") != strlen(aux)) {
+        show_error(nr);
+        continue;
+      }
+      compress_command(arena, atol(aux));
+    } else if (strcmp(command, "SAVE") == 0 || strcmp(command, "LOAD") == 0) {
+      if (nr != 1) {
+        show_error(nr);
+        continue;
+      }
+      aux = strtok(NULL, " \n");
+      if (aux == NULL) {
+        show_error(nr);
+      } else if (command[0] == 'S') {
+        save_command(arena, aux);
+      } else {
+        load_command(&table, aux);
+      }
+    } else if (strncmp(command, "DEALLOC_ARENA", 13) == 0) {
+      if (nr != 0) {
+        show_error(nr);
+        continue;
+      }
+      if (dealloc_command(&table) == 0) {
+        break;
+      }
+    } else if (strcmp(command, "USE") == 0) {
+      aux = strtok(NULL, " \n");
+      if (nr != 1 || aux == NULL || !use_command(&table, aux)) {
+        show_error(nr);
+      }
+    } else if (strncmp(command, "CLONE_ARENA", 11) == 0) {
+      if (nr != 0) {
+        show_error(nr);
+        continue;
+      }
+      clone_command(&table);
     } else {
       show_error(nr);
       // printf("Invalid command. Please try again.\n");
     }
   }
+  journal_close();
+  free_table(&table);
   return 0;
 }
\ No newline at end of file
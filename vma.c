@@ -0,0 +1,2968 @@
+#define _GNU_SOURCE
+#include "vma.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#define POOL_CHUNK_NODES 1024
+#define FIND_WINDOW 128  // pattern-urile mai lungi au fereastra alocată
+#define FIND_MISSES 64   // candidații falși tolerați, plus unul la 32 octeți
+#define POOL_BATCH 8  // nodurile mutate odată între un cache și pool-ul comun
+
+// Formatul snapshot-ului, în ordinea nativă a octeților: antetul, tabela
+// miniblock-urilor în ordinea adreselor, apoi, de la offset-uri aliniate la
+// pagină ca să poată fi mapate, bitmap-ul paginilor scrise și datele arenei.
+#define SNAPSHOT_MAGIC "VMASNAP1"
+typedef struct snapshot_header {
+  char magic[8];
+  uint64_t arena_size;
+  uint64_t miniblocks;
+  uint64_t page_shift;
+  uint64_t bitmap_offset, data_offset;
+} snapshot_header;
+typedef struct snapshot_miniblock {
+  uint64_t start_address, size;
+  uint64_t perm;
+} snapshot_miniblock;
+
+static void pool_init(pool_t* pool, size_t node_size, pool_t* shared) {
+  const size_t align = sizeof(uint64_t);
+  pool->node_size = (node_size + align - 1) / align * align;
+  pool->free_list = NULL;
+  pool->free_count = 0;
+  pool->chunks = NULL;
+  pool->shared = shared;
+#ifdef VMA_THREADS
+  pthread_mutex_init(&pool->lock, NULL);
+#endif
+}
+static int pool_grow(pool_t* pool) {
+  pool_chunk* chunk =
+      malloc(sizeof(pool_chunk) + pool->node_size * POOL_CHUNK_NODES);
+  if (chunk == NULL) {
+    return 0;
+  }
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+  char* node = (char*)(chunk + 1);
+  for (unsigned int i = 0; i < POOL_CHUNK_NODES; i++) {
+    *(void**)node = pool->free_list;
+    pool->free_list = node;
+    node += pool->node_size;
+  }
+  pool->free_count += POOL_CHUNK_NODES;
+  return 1;
+}
+static void pool_lock(pool_t* pool) {
+#ifdef VMA_THREADS
+  pthread_mutex_lock(&pool->lock);
+#else
+  (void)pool;
+#endif
+}
+static void pool_unlock(pool_t* pool) {
+#ifdef VMA_THREADS
+  pthread_mutex_unlock(&pool->lock);
+#else
+  (void)pool;
+#endif
+}
+// Ia din pool-ul comun un lot de cel mult POOL_BATCH noduri.
+static int pool_refill(pool_t* pool) {
+  pool_t* shared = pool->shared;
+  pool_lock(shared);
+  for (unsigned int i = 0; i < POOL_BATCH; i++) {
+    if (shared->free_list == NULL && !pool_grow(shared)) {
+      break;
+    }
+    void* node = shared->free_list;
+    shared->free_list = *(void**)node;
+    shared->free_count--;
+    *(void**)node = pool->free_list;
+    pool->free_list = node;
+    pool->free_count++;
+  }
+  pool_unlock(shared);
+  return pool->free_list != NULL;
+}
+// Dă înapoi pool-ului comun primele n noduri libere.
+static void pool_spill(pool_t* pool, unsigned int n) {
+  if (n == 0) {
+    return;
+  }
+  void* first = pool->free_list;
+  void* last = first;
+  for (unsigned int i = 1; i < n; i++) {
+    last = *(void**)last;
+  }
+  pool->free_list = *(void**)last;
+  pool->free_count -= n;
+  pool_t* shared = pool->shared;
+  pool_lock(shared);
+  *(void**)last = shared->free_list;
+  shared->free_list = first;
+  shared->free_count += n;
+  pool_unlock(shared);
+}
+static void* pool_alloc(pool_t* pool) {
+  if (pool->free_list == NULL &&
+      !(pool->shared != NULL ? pool_refill(pool) : pool_grow(pool))) {
+    return NULL;
+  }
+  void* node = pool->free_list;
+  pool->free_list = *(void**)node;
+  pool->free_count--;
+  return node;
+}
+static void pool_free(pool_t* pool, void* node) {
+  *(void**)node = pool->free_list;
+  pool->free_list = node;
+  pool->free_count++;
+  if (pool->shared != NULL && pool->free_count >= 2 * POOL_BATCH) {
+    pool_spill(pool, POOL_BATCH);
+  }
+}
+// Un cache își dă nodurile înapoi pool-ului comun; celelalte pool-uri își
+// eliberează zonele, deci și nodurile încă folosite.
+static void pool_destroy(pool_t* pool) {
+  if (pool->shared != NULL) {
+    pool_spill(pool, pool->free_count);
+  }
+  while (pool->chunks != NULL) {
+    pool_chunk* aux = pool->chunks;
+    pool->chunks = aux->next;
+    free(aux);
+  }
+  pool->free_list = NULL;
+  pool->free_count = 0;
+#ifdef VMA_THREADS
+  pthread_mutex_destroy(&pool->lock);
+#endif
+}
+uint64_t vma_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+void vma_hist_add(vma_hist* hist, uint64_t ns) {
+  unsigned int bucket = 0;
+  while (bucket + 1 < VMA_HIST_BUCKETS && (ns >> (bucket + 1)) != 0) {
+    bucket++;
+  }
+#ifdef VMA_THREADS
+  __atomic_fetch_add(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->total_ns, ns, __ATOMIC_RELAXED);
+#else
+  hist->buckets[bucket]++;
+  hist->count++;
+  hist->total_ns += ns;
+#endif
+}
+uint64_t vma_hist_percentile(const vma_hist* hist, unsigned int p) {
+  uint64_t rank = (hist->count * p + 99) / 100, seen = 0;
+  for (unsigned int i = 0; i < VMA_HIST_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank && seen != 0) {
+      return (uint64_t)2 << i;
+    }
+  }
+  return 0;
+}
+
+static list_t* create_block_list() {
+  list_t* list = malloc(sizeof(list_t));
+  if (list == NULL) {
+    return NULL;
+  }
+  list->size = 0;
+  list->head = NULL;
+  list->last = NULL;
+  list->root = NULL;
+  return list;
+}
+// Fiecare arenă are generatorul ei, ca arene diferite să poată fi modificate
+// din thread-uri diferite.
+static uint32_t next_priority(arena_t* arena) {
+  uint32_t state = arena->seed;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  arena->seed = state;
+  return state;
+}
+// Împarte treap-ul în blocurile cu adresa < address și cele cu adresa >=
+// address.
+static void split_index(block_t* root, uint64_t address, block_t** left,
+                        block_t** right) {
+  if (root == NULL) {
+    *left = NULL;
+    *right = NULL;
+  } else if (root->start_address < address) {
+    split_index(root->right, address, &root->right, right);
+    *left = root;
+  } else {
+    split_index(root->left, address, left, &root->left);
+    *right = root;
+  }
+}
+// Toate adresele din left sunt mai mici decât cele din right.
+static block_t* merge_index(block_t* left, block_t* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  if (left->priority > right->priority) {
+    left->right = merge_index(left->right, right);
+    return left;
+  }
+  right->left = merge_index(left, right->left);
+  return right;
+}
+static void insert_in_index(list_t* list, block_t* block) {
+  block_t *left, *right;
+  split_index(list->root, block->start_address, &left, &right);
+  list->root = merge_index(merge_index(left, block), right);
+}
+static block_t* erase_from_index(block_t* root, const block_t* block) {
+  if (root == block) {
+    return merge_index(root->left, root->right);
+  }
+  if (block->start_address < root->start_address) {
+    root->left = erase_from_index(root->left, block);
+  } else {
+    root->right = erase_from_index(root->right, block);
+  }
+  return root;
+}
+// Cursorii sunt mutați și de READ/WRITE concurente, sub lock-ul partajat.
+// Indică mereu un nod viu: eliberarea nodului îi resetează.
+#ifdef VMA_THREADS
+#define LOAD_CURSOR(cursor) __atomic_load_n(&(cursor), __ATOMIC_RELAXED)
+#define STORE_CURSOR(cursor, node) \
+  __atomic_store_n(&(cursor), (node), __ATOMIC_RELAXED)
+#else
+#define LOAD_CURSOR(cursor) (cursor)
+#define STORE_CURSOR(cursor, node) ((cursor) = (node))
+#endif
+#define CURSOR_STEPS 3  // vecinii încercați înainte de a coborî în arbore
+// Mută cursorul pe block, iar cursorul de miniblock la începutul lui.
+static void move_cursor(arena_t* arena, block_t* block) {
+  STORE_CURSOR(arena->cursor, block);
+  STORE_CURSOR(arena->miniblock_cursor, block->miniblocks.head);
+}
+// Ultimul bloc care începe la o adresă <= address, sau NULL. Căutarea
+// pornește de la cursor și trece la index doar dacă rezultatul nu e la
+// câțiva vecini de el.
+static block_t* find_block(arena_t* arena, uint64_t address) {
+  block_t* cursor = LOAD_CURSOR(arena->cursor);
+  block_t* curr = cursor;
+  for (int step = 0; curr != NULL && step <= CURSOR_STEPS; step++) {
+    if (curr->start_address > address) {
+      curr = curr->prev;
+      if (curr == NULL) {
+        VMA_STAT_ADD(arena, block_hits, 1);
+        return NULL;
+      }
+    } else if (curr->next != NULL && curr->next->start_address <= address) {
+      curr = curr->next;
+    } else {
+      VMA_STAT_ADD(arena, block_hits, 1);
+      if (curr != cursor) {
+        move_cursor(arena, curr);
+      }
+      return curr;
+    }
+  }
+  VMA_STAT_ADD(arena, block_misses, 1);
+  curr = arena->alloc_list->root;
+  block_t* found = NULL;
+  uint64_t visited = 0;
+  while (curr != NULL) {
+    visited++;
+    if (curr->start_address <= address) {
+      found = curr;
+      curr = curr->right;
+    } else {
+      curr = curr->left;
+    }
+  }
+  VMA_STAT_ADD(arena, nodes_visited, visited);
+  if (found != NULL) {
+    move_cursor(arena, found);
+  }
+  return found;
+}
+// Indexul zonelor libere. O zonă liberă este un interval maximal din
+// [0, arena_size) neacoperit de niciun bloc.
+static uint64_t extent_max(const extent_t* node) {
+  return node != NULL ? node->max_size : 0;
+}
+static void extent_update(extent_t* node) {
+  uint64_t max = node->size;
+  if (extent_max(node->left) > max) {
+    max = extent_max(node->left);
+  }
+  if (extent_max(node->right) > max) {
+    max = extent_max(node->right);
+  }
+  node->max_size = max;
+}
+static void split_extents(extent_t* root, uint64_t address, extent_t** left,
+                          extent_t** right) {
+  if (root == NULL) {
+    *left = NULL;
+    *right = NULL;
+  } else if (root->start_address < address) {
+    split_extents(root->right, address, &root->right, right);
+    extent_update(root);
+    *left = root;
+  } else {
+    split_extents(root->left, address, left, &root->left);
+    extent_update(root);
+    *right = root;
+  }
+}
+static extent_t* merge_extents(extent_t* left, extent_t* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  if (left->priority > right->priority) {
+    left->right = merge_extents(left->right, right);
+    extent_update(left);
+    return left;
+  }
+  right->left = merge_extents(left, right->left);
+  extent_update(right);
+  return right;
+}
+static int size_less(const extent_t* a, uint64_t size, uint64_t address) {
+  return a->size < size || (a->size == size && a->start_address < address);
+}
+// Zonele bucket-ului cu cheia < (size, address), respectiv >=.
+static void split_sizes(extent_t* root, uint64_t size, uint64_t address,
+                        extent_t** left, extent_t** right) {
+  if (root == NULL) {
+    *left = NULL;
+    *right = NULL;
+  } else if (size_less(root, size, address)) {
+    split_sizes(root->size_right, size, address, &root->size_right, right);
+    *left = root;
+  } else {
+    split_sizes(root->size_left, size, address, left, &root->size_left);
+    *right = root;
+  }
+}
+static extent_t* merge_sizes(extent_t* left, extent_t* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  if (left->priority > right->priority) {
+    left->size_right = merge_sizes(left->size_right, right);
+    return left;
+  }
+  right->size_left = merge_sizes(left, right->size_left);
+  return right;
+}
+static unsigned int size_bucket(uint64_t size) {
+  unsigned int bucket = 0;
+  while (size >> 1 != 0) {
+    size >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+static extent_t* insert_address(extent_t* root, extent_t* extent) {
+  if (root == NULL || extent->priority > root->priority) {
+    split_extents(root, extent->start_address, &extent->left, &extent->right);
+    extent_update(extent);
+    return extent;
+  }
+  if (extent->start_address < root->start_address) {
+    root->left = insert_address(root->left, extent);
+  } else {
+    root->right = insert_address(root->right, extent);
+  }
+  extent_update(root);
+  return root;
+}
+static extent_t* erase_address(extent_t* root, const extent_t* extent) {
+  if (root == extent) {
+    return merge_extents(root->left, root->right);
+  }
+  if (extent->start_address < root->start_address) {
+    root->left = erase_address(root->left, extent);
+  } else {
+    root->right = erase_address(root->right, extent);
+  }
+  extent_update(root);
+  return root;
+}
+// Recalculează max_size pe drumul până la zona care începe la address,
+// după ce dimensiunea ei s-a schimbat. Zonele libere sunt disjuncte, deci
+// micșorarea sau mărirea uneia nu le schimbă ordinea.
+static void refresh_address(extent_t* root, uint64_t address) {
+  if (root->start_address != address) {
+    refresh_address(address < root->start_address ? root->left : root->right,
+                    address);
+  }
+  extent_update(root);
+}
+static extent_t* insert_size(extent_t* root, extent_t* extent) {
+  if (root == NULL || extent->priority > root->priority) {
+    split_sizes(root, extent->size, extent->start_address,
+                &extent->size_left, &extent->size_right);
+    return extent;
+  }
+  if (size_less(extent, root->size, root->start_address)) {
+    root->size_left = insert_size(root->size_left, extent);
+  } else {
+    root->size_right = insert_size(root->size_right, extent);
+  }
+  return root;
+}
+static extent_t* erase_size(extent_t* root, const extent_t* extent) {
+  if (root == extent) {
+    return merge_sizes(root->size_left, root->size_right);
+  }
+  if (size_less(extent, root->size, root->start_address)) {
+    root->size_left = erase_size(root->size_left, extent);
+  } else {
+    root->size_right = erase_size(root->size_right, extent);
+  }
+  return root;
+}
+static void add_to_bucket(arena_t* arena, extent_t* extent) {
+  unsigned int bucket = size_bucket(extent->size);
+  arena->free_buckets[bucket] =
+      insert_size(arena->free_buckets[bucket], extent);
+  arena->free_mask |= (uint64_t)1 << bucket;
+}
+static void remove_from_bucket(arena_t* arena, extent_t* extent) {
+  unsigned int bucket = size_bucket(extent->size);
+  arena->free_buckets[bucket] = erase_size(arena->free_buckets[bucket], extent);
+  if (arena->free_buckets[bucket] == NULL) {
+    arena->free_mask &= ~((uint64_t)1 << bucket);
+  }
+}
+// Inserează zona imediat după prev (prima, dacă prev e NULL).
+static void insert_extent(arena_t* arena, extent_t* extent, extent_t* prev) {
+  extent->prev = prev;
+  extent->next = prev != NULL ? prev->next : arena->free_head;
+  if (extent->next != NULL) {
+    extent->next->prev = extent;
+  }
+  if (prev != NULL) {
+    prev->next = extent;
+  } else {
+    arena->free_head = extent;
+  }
+  arena->free_root = insert_address(arena->free_root, extent);
+  add_to_bucket(arena, extent);
+}
+static void erase_extent(arena_t* arena, extent_t* extent) {
+  if (extent->prev != NULL) {
+    extent->prev->next = extent->next;
+  } else {
+    arena->free_head = extent->next;
+  }
+  if (extent->next != NULL) {
+    extent->next->prev = extent->prev;
+  }
+  arena->free_root = erase_address(arena->free_root, extent);
+  remove_from_bucket(arena, extent);
+}
+// Schimbă limitele unei zone, păstrând-o între aceleași vecine.
+static void resize_extent(arena_t* arena, extent_t* extent, uint64_t start,
+                          uint64_t size) {
+  remove_from_bucket(arena, extent);
+  extent->start_address = start;
+  extent->size = size;
+  refresh_address(arena->free_root, start);
+  add_to_bucket(arena, extent);
+}
+static extent_t* create_extent(arena_t* arena) {
+  extent_t* extent = pool_alloc(&arena->extent_pool);
+  if (extent != NULL) {
+    extent->left = NULL;
+    extent->right = NULL;
+    extent->size_left = NULL;
+    extent->size_right = NULL;
+    extent->priority = next_priority(arena);
+  }
+  return extent;
+}
+// Ultima zonă liberă care începe la o adresă <= address, sau NULL.
+static extent_t* find_extent(const arena_t* arena, uint64_t address) {
+  extent_t* curr = arena->free_root;
+  extent_t* found = NULL;
+  while (curr != NULL) {
+    if (curr->start_address <= address) {
+      found = curr;
+      curr = curr->right;
+    } else {
+      curr = curr->left;
+    }
+  }
+  return found;
+}
+// Prima zonă, în ordinea adreselor, care începe la o adresă >= from și are
+// cel puțin size octeți. Subarborii cu max_size < size sunt ocoliți.
+static extent_t* first_fit(extent_t* node, uint64_t from, uint64_t size) {
+  if (node == NULL || node->max_size < size) {
+    return NULL;
+  }
+  if (node->start_address >= from) {
+    extent_t* found = first_fit(node->left, from, size);
+    if (found != NULL) {
+      return found;
+    }
+    if (node->size >= size) {
+      return node;
+    }
+  }
+  return first_fit(node->right, from, size);
+}
+// Cea mai mică zonă de cel puțin size octeți: întâi în bucket-ul lui size,
+// apoi minimul primului bucket nevid de deasupra.
+static extent_t* best_fit(const arena_t* arena, uint64_t size) {
+  unsigned int bucket = size_bucket(size);
+  extent_t* found = NULL;
+  for (extent_t* curr = arena->free_buckets[bucket]; curr != NULL;) {
+    if (curr->size >= size) {
+      found = curr;
+      curr = curr->size_left;
+    } else {
+      curr = curr->size_right;
+    }
+  }
+  if (found != NULL || bucket + 1 >= VMA_SIZE_BUCKETS) {
+    return found;
+  }
+  uint64_t above = arena->free_mask & ~(((uint64_t)2 << bucket) - 1);
+  if (above == 0) {
+    return NULL;
+  }
+  found = arena->free_buckets[size_bucket(above & -above)];
+  while (found->size_left != NULL) {
+    found = found->size_left;
+  }
+  return found;
+}
+// Scoate [address, address + size) din zona liberă care îl conține. Dacă
+// rămân două bucăți, cea din dreapta folosește *spare.
+static void take_extent(arena_t* arena, uint64_t address, uint64_t size,
+                        extent_t** spare) {
+  extent_t* extent = find_extent(arena, address);
+  uint64_t end = extent->start_address + extent->size;
+  if (address > extent->start_address) {
+    resize_extent(arena, extent, extent->start_address,
+                  address - extent->start_address);
+    if (address + size < end) {
+      extent_t* right = *spare;
+      *spare = NULL;
+      right->start_address = address + size;
+      right->size = end - right->start_address;
+      insert_extent(arena, right, extent);
+    }
+  } else if (address + size < end) {
+    resize_extent(arena, extent, address + size, end - address - size);
+  } else {
+    erase_extent(arena, extent);
+    pool_free(&arena->extent_pool, extent);
+  }
+}
+// Adaugă [address, address + size) la zonele libere, lipind-o de vecinii
+// liberi. Dacă nu are vecini, folosește *spare.
+static void release_extent(arena_t* arena, uint64_t address, uint64_t size,
+                           extent_t** spare) {
+  extent_t* before = find_extent(arena, address);
+  extent_t* prev = before;
+  extent_t* next = before != NULL ? before->next : arena->free_head;
+  if (prev != NULL && prev->start_address + prev->size != address) {
+    prev = NULL;
+  }
+  if (next != NULL && next->start_address != address + size) {
+    next = NULL;
+  }
+  if (prev != NULL) {
+    uint64_t total = prev->size + size;
+    if (next != NULL) {
+      total += next->size;
+      erase_extent(arena, next);
+      pool_free(&arena->extent_pool, next);
+    }
+    resize_extent(arena, prev, prev->start_address, total);
+  } else if (next != NULL) {
+    resize_extent(arena, next, address, next->size + size);
+  } else {
+    extent_t* extent = *spare;
+    *spare = NULL;
+    extent->start_address = address;
+    extent->size = size;
+    insert_extent(arena, extent, before);
+  }
+}
+static void lock_structure(arena_t* arena, int exclusive) {
+#ifdef VMA_THREADS
+  if (exclusive) {
+    pthread_rwlock_wrlock(&arena->lock);
+  } else {
+    pthread_rwlock_rdlock(&arena->lock);
+  }
+#else
+  (void)arena;
+  (void)exclusive;
+#endif
+}
+static void unlock_structure(arena_t* arena) {
+#ifdef VMA_THREADS
+  pthread_rwlock_unlock(&arena->lock);
+#else
+  (void)arena;
+#endif
+}
+// Ia, în ordinea indicilor, shard-urile fâșiilor atinse de
+// [address, address + size) și întoarce masca lor pentru unlock_shards.
+static uint64_t lock_shards(arena_t* arena, uint64_t address, uint64_t size,
+                            int exclusive) {
+#ifdef VMA_THREADS
+  uint64_t first = address >> VMA_SHARD_SHIFT;
+  uint64_t last = (address + (size != 0 ? size - 1 : 0)) >> VMA_SHARD_SHIFT;
+  uint64_t mask = ~(uint64_t)0;
+  if (last - first + 1 < VMA_SHARDS) {
+    mask = 0;
+    for (uint64_t i = first; i <= last; i++) {
+      mask |= (uint64_t)1 << (i % VMA_SHARDS);
+    }
+  }
+  for (unsigned int i = 0; i < VMA_SHARDS; i++) {
+    if ((mask >> i) & 1) {
+      if (exclusive) {
+        pthread_rwlock_wrlock(&arena->shards[i]);
+      } else {
+        pthread_rwlock_rdlock(&arena->shards[i]);
+      }
+    }
+  }
+  return mask;
+#else
+  (void)arena;
+  (void)address;
+  (void)size;
+  (void)exclusive;
+  return 0;
+#endif
+}
+static void unlock_shards(arena_t* arena, uint64_t mask) {
+#ifdef VMA_THREADS
+  for (unsigned int i = 0; i < VMA_SHARDS; i++) {
+    if ((mask >> i) & 1) {
+      pthread_rwlock_unlock(&arena->shards[i]);
+    }
+  }
+#else
+  (void)arena;
+  (void)mask;
+#endif
+}
+static void domain_lock(vma_domain* domain) {
+#ifdef VMA_THREADS
+  pthread_mutex_lock(&domain->lock);
+#else
+  (void)domain;
+#endif
+}
+static void domain_unlock(vma_domain* domain) {
+#ifdef VMA_THREADS
+  pthread_mutex_unlock(&domain->lock);
+#else
+  (void)domain;
+#endif
+}
+vma_domain* vma_domain_create(void) {
+  vma_domain* domain = malloc(sizeof(vma_domain));
+  if (domain == NULL) {
+    return NULL;
+  }
+  pool_init(&domain->block_pool, sizeof(block_t), NULL);
+  pool_init(&domain->miniblock_pool, sizeof(miniblock_t), NULL);
+  pool_init(&domain->extent_pool, sizeof(extent_t), NULL);
+  domain->backing = -1;
+  domain->backing_size = 0;
+  domain->users = 1;
+#ifdef VMA_THREADS
+  pthread_mutex_init(&domain->lock, NULL);
+#endif
+  return domain;
+}
+static void release_domain(vma_domain* domain) {
+  domain_lock(domain);
+  unsigned int users = --domain->users;
+  domain_unlock(domain);
+  if (users != 0) {
+    return;
+  }
+  pool_destroy(&domain->block_pool);
+  pool_destroy(&domain->miniblock_pool);
+  pool_destroy(&domain->extent_pool);
+  if (domain->backing >= 0) {
+    close(domain->backing);
+  }
+#ifdef VMA_THREADS
+  pthread_mutex_destroy(&domain->lock);
+#endif
+  free(domain);
+}
+void vma_domain_destroy(vma_domain* domain) { release_domain(domain); }
+arena_t* alloc_arena(const uint64_t size) { return alloc_arena_in(NULL, size); }
+arena_t* alloc_arena_in(vma_domain* domain, const uint64_t size) {
+  arena_t* arena = malloc(sizeof(arena_t));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->alloc_list = create_block_list();
+  if (arena->alloc_list == NULL) {
+    free(arena);
+    return NULL;
+  }
+  arena->arena_size = size;
+  arena->free_size = size;
+  arena->no_miniblocks = 0;
+  arena->data = NULL;
+  arena->committed = NULL;
+  arena->committed_pages = 0;
+  arena->mapped = 0;
+  arena->backing = -1;
+  arena->backing_offset = 0;
+  arena->domain = domain;
+  arena->parent = NULL;
+  arena->clones = NULL;
+  arena->next_clone = NULL;
+  arena->prev_clone = NULL;
+  arena->private_pages = NULL;
+  arena->page_shift = 0;
+  for (long page = sysconf(_SC_PAGESIZE); page > 1; page >>= 1) {
+    arena->page_shift++;
+  }
+  pool_init(&arena->block_pool, sizeof(block_t),
+            domain != NULL ? &domain->block_pool : NULL);
+  pool_init(&arena->miniblock_pool, sizeof(miniblock_t),
+            domain != NULL ? &domain->miniblock_pool : NULL);
+  pool_init(&arena->extent_pool, sizeof(extent_t),
+            domain != NULL ? &domain->extent_pool : NULL);
+  arena->free_root = NULL;
+  arena->free_head = NULL;
+  memset(arena->free_buckets, 0, sizeof(arena->free_buckets));
+  arena->free_mask = 0;
+  arena->next_fit = 0;
+  arena->cursor = NULL;
+  arena->miniblock_cursor = NULL;
+  arena->seed = 2463534242u;
+  arena->pack_after = 0;
+  arena->clock = 0;
+  arena->pack_cursor = 0;
+  arena->packed = NULL;
+  arena->touched = NULL;
+  arena->packed_pages = 0;
+  arena->packed_bytes = 0;
+  arena->packing = 0;
+#ifdef VMA_THREADS
+  pthread_rwlock_init(&arena->lock, NULL);
+  for (int i = 0; i < VMA_SHARDS; i++) {
+    pthread_rwlock_init(&arena->shards[i], NULL);
+  }
+#endif
+#ifdef VMA_STATS
+  memset(&arena->stats, 0, sizeof(arena->stats));
+#endif
+  if (domain != NULL) {
+    domain_lock(domain);
+    domain->users++;
+    domain_unlock(domain);
+  }
+  if (size != 0) {
+    extent_t* extent = create_extent(arena);
+    if (extent == NULL) {
+      // Arena e deja completă, deci e eliberată ca oricare alta.
+      dealloc_arena(arena);
+      return NULL;
+    }
+    extent->start_address = 0;
+    extent->size = size;
+    insert_extent(arena, extent, NULL);
+  }
+  return arena;
+}
+static uint64_t bitmap_size(const arena_t* arena) {
+  uint64_t pages = (arena->arena_size >> arena->page_shift) + 1;
+  return (pages / 64 + 1) * sizeof(uint64_t);
+}
+static void* map_bitmap(const arena_t* arena) {
+  void* bitmap = mmap(NULL, bitmap_size(arena), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return bitmap != MAP_FAILED ? bitmap : NULL;
+}
+static uint64_t page_align(const arena_t* arena, uint64_t offset) {
+  uint64_t mask = ((uint64_t)1 << arena->page_shift) - 1;
+  return (offset + mask) & ~mask;
+}
+// Un memfd gol pentru datele arenei, sau -1. Într-un domeniu, e memfd-ul
+// comun, mărit cu o zonă nouă al cărei început ajunge în *offset.
+static int create_backing(const arena_t* arena, uint64_t* offset) {
+  uint64_t size = page_align(arena, arena->arena_size);
+  vma_domain* domain = arena->domain;
+  if (domain == NULL) {
+    int fd = memfd_create("vma_arena", MFD_CLOEXEC);
+    if (fd >= 0 && ftruncate(fd, size) != 0) {
+      close(fd);
+      fd = -1;
+    }
+    *offset = 0;
+    return fd;
+  }
+  domain_lock(domain);
+  if (domain->backing < 0) {
+    domain->backing = memfd_create("vma_domain", MFD_CLOEXEC);
+  }
+  int fd = domain->backing;
+  if (fd >= 0 && ftruncate(fd, domain->backing_size + size) == 0) {
+    *offset = domain->backing_size;
+    domain->backing_size += size;
+  } else {
+    fd = -1;
+  }
+  domain_unlock(domain);
+  return fd;
+}
+// Renunță la memfd-ul creat de create_backing; zona din memfd-ul comun
+// rămâne rezervată, dar paginile ei sunt eliberate.
+static void drop_backing(const arena_t* arena, int fd, uint64_t offset) {
+  if (arena->domain == NULL) {
+    close(fd);
+  } else {
+    fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+              page_align(arena, arena->arena_size));
+  }
+}
+// Înlocuiește maparea datelor cu una partajată a memfd-ului fd.
+static int map_backing(arena_t* arena, int fd, uint64_t offset) {
+  return mmap(arena->data, arena->arena_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_FIXED | MAP_NORESERVE, fd,
+              offset) != MAP_FAILED;
+}
+// Rezervă memoria arenei o singură dată: adresa N din arenă este data + N.
+// Paginile sunt materializate de kernel abia la prima scriere. Datele stau
+// într-un memfd, ca să poată fi mapate privat de clone; fără memfd, arena
+// folosește o mapare anonimă și nu poate fi clonată.
+static int reserve_arena_data(arena_t* arena) {
+  if (arena->data != NULL) {
+    return 1;
+  }
+  void* data = mmap(NULL, arena->arena_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    return 0;
+  }
+  void* committed = map_bitmap(arena);
+  if (committed == NULL) {
+    munmap(data, arena->arena_size);
+    return 0;
+  }
+  arena->data = data;
+  arena->committed = committed;
+  uint64_t offset;
+  int fd = create_backing(arena, &offset);
+  if (fd >= 0 && !map_backing(arena, fd, offset)) {
+    drop_backing(arena, fd, offset);
+    fd = -1;
+  }
+  arena->backing = fd;
+  arena->backing_offset = offset;
+  return 1;
+}
+static uint64_t load_word(const uint64_t* word) {
+#ifdef VMA_THREADS
+  return __atomic_load_n(word, __ATOMIC_RELAXED);
+#else
+  return *word;
+#endif
+}
+static int page_committed(const arena_t* arena, uint64_t page) {
+  return (load_word(&arena->committed[page / 64]) >> (page % 64)) & 1;
+}
+// Masca biților [bit, bit + n) dintr-un cuvânt al bitmap-ului.
+static uint64_t bit_range(uint64_t bit, uint64_t n) {
+  return (n == 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1)) << bit;
+}
+// Setează în bitmap biții paginilor atinse de [address, address + size) și
+// întoarce câți erau nesetați. Scrierile concurente pot împărți un cuvânt,
+// deci biții sunt setați atomic.
+static uint64_t set_page_bits(const arena_t* arena, uint64_t* bitmap,
+                              uint64_t address, uint64_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  uint64_t page = address >> arena->page_shift;
+  uint64_t last = (address + size - 1) >> arena->page_shift;
+  uint64_t added = 0;
+  while (page <= last) {
+    uint64_t bit = page % 64;
+    uint64_t n = last - page + 1 < 64 - bit ? last - page + 1 : 64 - bit;
+    uint64_t mask = bit_range(bit, n);
+    uint64_t* word = &bitmap[page / 64];
+    if ((load_word(word) & mask) != mask) {
+#ifdef VMA_THREADS
+      uint64_t old = __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+#else
+      uint64_t old = *word;
+      *word |= mask;
+#endif
+      added += __builtin_popcountll(mask & ~old);
+    }
+    page += n;
+  }
+  return added;
+}
+// Marchează paginile atinse de o scriere în [address, address + size).
+static void commit_pages(arena_t* arena, uint64_t address, uint64_t size) {
+  uint64_t added = set_page_bits(arena, arena->committed, address, size);
+  if (added != 0) {
+#ifdef VMA_THREADS
+    __atomic_fetch_add(&arena->committed_pages, added, __ATOMIC_RELAXED);
+#else
+    arena->committed_pages += added;
+#endif
+  }
+  if (arena->private_pages != NULL) {
+    set_page_bits(arena, arena->private_pages, address, size);
+  }
+}
+// Înainte ca un părinte să modifice [address, address + size), clonele care
+// încă văd aceste pagini din memfd-ul lui primesc copii private: scrierea
+// atomică a unui octet neschimbat face kernel-ul să copieze pagina.
+static void unshare_pages(arena_t* arena, uint64_t address, uint64_t size) {
+  if (arena->clones == NULL || size == 0) {
+    return;
+  }
+  const unsigned int shift = arena->page_shift;
+  uint64_t last = (address + size - 1) >> shift;
+  for (arena_t* clone = arena->clones; clone != NULL;
+       clone = clone->next_clone) {
+    for (uint64_t page = address >> shift; page <= last; page++) {
+      if (!((load_word(&clone->private_pages[page / 64]) >> (page % 64)) &
+            1)) {
+        __atomic_fetch_or(&clone->data[page << shift], 0, __ATOMIC_RELAXED);
+        set_page_bits(clone, clone->private_pages, page << shift, 1);
+      }
+    }
+  }
+}
+// Sfârșitul seriei de pagini de la address, toate scrise sau toate nescrise
+// (*committed), limitat la end.
+static uint64_t run_end(const arena_t* arena, uint64_t address, uint64_t end,
+                        int* committed) {
+  const unsigned int shift = arena->page_shift;
+  *committed = page_committed(arena, address >> shift);
+  uint64_t next = ((address >> shift) + 1) << shift;
+  while (next < end && page_committed(arena, next >> shift) == *committed) {
+    next += (uint64_t)1 << shift;
+  }
+  return next < end ? next : end;
+}
+// Începutul seriei de pagini care se termină la end, limitat la start.
+static uint64_t run_start(const arena_t* arena, uint64_t start, uint64_t end,
+                          int* committed) {
+  const unsigned int shift = arena->page_shift;
+  *committed = page_committed(arena, (end - 1) >> shift);
+  uint64_t prev = ((end - 1) >> shift) << shift;
+  while (prev > start && page_committed(arena, (prev - 1) >> shift) ==
+                             *committed) {
+    prev -= (uint64_t)1 << shift;
+  }
+  return prev > start ? prev : start;
+}
+// Trimite zona [address, address + size) la sink. Paginile nescrise sunt
+// trimise ca zerouri dintr-un buffer static, fără a le atinge în arenă.
+static void read_pages(arena_t* arena, uint64_t address, uint64_t size,
+                       vma_sink_fn sink, void* ctx) {
+  static const int8_t zeros[1 << 16];
+  uint64_t end = address + size;
+  while (address < end) {
+    int committed;
+    uint64_t next = run_end(arena, address, end, &committed);
+    if (committed) {
+      sink(ctx, arena->data + address, next - address);
+    } else {
+      for (uint64_t left = next - address; left > 0;) {
+        uint64_t n = left < sizeof(zeros) ? left : sizeof(zeros);
+        sink(ctx, zeros, n);
+        left -= n;
+      }
+    }
+    address = next;
+  }
+}
+// Dă înapoi sistemului paginile întregi [address, address + size), care se
+// vor citi apoi ca zerouri. Un memfd e golit cu MADV_REMOVE; într-o mapare
+// privată a unui fișier, MADV_DONTNEED ar readuce conținutul fișierului,
+// deci paginile sunt înlocuite cu unele anonime.
+static void release_pages(arena_t* arena, uint64_t address, uint64_t size) {
+  if (arena->backing >= 0) {
+    madvise(arena->data + address, size, MADV_REMOVE);
+  } else if (arena->mapped) {
+    mmap(arena->data + address, size, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    if (arena->private_pages != NULL) {
+      set_page_bits(arena, arena->private_pages, address, size);
+    }
+  } else {
+    madvise(arena->data + address, size, MADV_DONTNEED);
+  }
+}
+// Compresia paginilor reci. Codecul e un LZ77 simplu, în stilul LZ4: fiecare
+// secvență are un octet de control (în primii 4 biți numărul literalilor, în
+// ultimii 4 lungimea potrivirii minus PACK_MIN_MATCH, 15 însemnând că urmează
+// octeți de extensie), literalii și distanța potrivirii pe 2 octeți. Ultima
+// secvență are doar literali.
+#define PACK_HASH_BITS 12
+#define PACK_MIN_MATCH 4
+#define PACK_STEP 64  // paginile cercetate de o operație pentru compresie
+
+typedef struct packed_page {
+  uint32_t size;  // octeții din data
+  uint8_t data[];
+} packed_page;
+
+static void pack_length(uint8_t** out, size_t n) {
+  while (n >= 255) {
+    *(*out)++ = 255;
+    n -= 255;
+  }
+  *(*out)++ = (uint8_t)n;
+}
+static size_t unpack_length(const uint8_t** in) {
+  size_t n = 0;
+  uint8_t byte;
+  do {
+    byte = *(*in)++;
+    n += byte;
+  } while (byte == 255);
+  return n;
+}
+// Adaugă o secvență la *out; 0 dacă nu mai încape până la end. O potrivire
+// de lungime 0 marchează ultima secvență.
+static int pack_sequence(uint8_t** out, const uint8_t* end,
+                         const uint8_t* literals, size_t count,
+                         size_t distance, size_t match) {
+  size_t extra = match != 0 ? match - PACK_MIN_MATCH : 0;
+  if ((size_t)(end - *out) < count + count / 255 + extra / 255 + 5) {
+    return 0;
+  }
+  uint8_t* p = *out;
+  *p++ = (uint8_t)((count < 15 ? count : 15) << 4 | (extra < 15 ? extra : 15));
+  if (count >= 15) {
+    pack_length(&p, count - 15);
+  }
+  memcpy(p, literals, count);
+  p += count;
+  if (match != 0) {
+    *p++ = (uint8_t)distance;
+    *p++ = (uint8_t)(distance >> 8);
+    if (extra >= 15) {
+      pack_length(&p, extra - 15);
+    }
+  }
+  *out = p;
+  return 1;
+}
+// Comprimă cei n octeți de la src în dst și întoarce lungimea rezultatului,
+// sau 0 dacă depășește cap. Pozițiile sunt găsite printr-un hash al
+// primilor 4 octeți; după multe ratări la rând, pasul crește, ca datele
+// necompresibile să fie abandonate repede.
+static size_t lz_pack(const uint8_t* src, size_t n, uint8_t* dst,
+                      size_t cap) {
+  uint32_t table[1 << PACK_HASH_BITS];
+  memset(table, 0, sizeof(table));
+  uint8_t* out = dst;
+  const uint8_t* end = dst + cap;
+  size_t pos = 0, anchor = 0;
+  while (pos + PACK_MIN_MATCH <= n) {
+    uint32_t word;
+    memcpy(&word, src + pos, sizeof(word));
+    uint32_t hash = (word * 2654435761u) >> (32 - PACK_HASH_BITS);
+    size_t candidate = table[hash];
+    table[hash] = (uint32_t)pos + 1;
+    if (candidate == 0 || memcmp(src + candidate - 1, &word, 4) != 0) {
+      pos += 1 + ((pos - anchor) >> 6);
+      continue;
+    }
+    candidate--;
+    size_t match = PACK_MIN_MATCH;
+    while (pos + match < n && src[candidate + match] == src[pos + match]) {
+      match++;
+    }
+    if (!pack_sequence(&out, end, src + anchor, pos - anchor,
+                       pos - candidate, match)) {
+      return 0;
+    }
+    pos += match;
+    anchor = pos;
+  }
+  if (!pack_sequence(&out, end, src + anchor, n - anchor, 0, 0)) {
+    return 0;
+  }
+  return out - dst;
+}
+// Reface cei n octeți comprimați de lz_pack.
+static void lz_unpack(const uint8_t* src, uint8_t* dst, size_t n) {
+  size_t pos = 0;
+  for (;;) {
+    uint8_t token = *src++;
+    size_t count = token >> 4;
+    if (count == 15) {
+      count += unpack_length(&src);
+    }
+    memcpy(dst + pos, src, count);
+    src += count;
+    pos += count;
+    if (pos >= n) {
+      return;
+    }
+    size_t distance = src[0] | (size_t)src[1] << 8;
+    src += 2;
+    size_t match = token & 15;
+    if (match == 15) {
+      match += unpack_length(&src);
+    }
+    match += PACK_MIN_MATCH;
+    // Potrivirea se poate suprapune cu ea însăși, deci octet cu octet.
+    for (size_t i = 0; i < match; i++) {
+      dst[pos + i] = dst[pos + i - distance];
+    }
+    pos += match;
+  }
+}
+static packed_page* load_packed(const arena_t* arena, uint64_t page) {
+  if (arena->packed == NULL) {
+    return NULL;
+  }
+#ifdef VMA_THREADS
+  return __atomic_load_n(&arena->packed[page], __ATOMIC_RELAXED);
+#else
+  return arena->packed[page];
+#endif
+}
+static void store_packed(arena_t* arena, uint64_t page, packed_page* copy) {
+#ifdef VMA_THREADS
+  __atomic_store_n(&arena->packed[page], copy, __ATOMIC_RELAXED);
+#else
+  arena->packed[page] = copy;
+#endif
+}
+// Paginile diferite sunt comprimate sub shard-uri diferite, deci totalurile
+// sunt actualizate atomic.
+static void count_packed(arena_t* arena, uint64_t pages, uint64_t bytes) {
+#ifdef VMA_THREADS
+  __atomic_fetch_add(&arena->packed_pages, pages, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&arena->packed_bytes, bytes, __ATOMIC_RELAXED);
+#else
+  arena->packed_pages += pages;
+  arena->packed_bytes += bytes;
+#endif
+}
+// Pagina page n-a fost accesată de cel puțin pack_after operații. Un acces
+// concurent o poate marca cu un ceas mai nou decât clock.
+static int page_cold(const arena_t* arena, uint64_t clock, uint64_t page) {
+  uint64_t touched = __atomic_load_n(&arena->touched[page], __ATOMIC_RELAXED);
+  return touched <= clock && clock - touched >= arena->pack_after;
+}
+// Comprimă pagina scrisă page, cu shard-ul ei luat exclusiv. O pagină care
+// nu se micșorează destul e doar marcată ca accesată, ca să nu fie
+// reîncercată la fiecare trecere.
+static void pack_page(arena_t* arena, uint64_t page, uint64_t clock) {
+  const uint64_t page_size = (uint64_t)1 << arena->page_shift;
+  const uint64_t start = page << arena->page_shift;
+  const size_t cap = page_size - page_size / 8;
+  packed_page* copy = malloc(sizeof(packed_page) + cap);
+  if (copy == NULL) {
+    return;
+  }
+  VMA_TIMER_START(pack_start);
+  size_t size =
+      lz_pack((const uint8_t*)arena->data + start, page_size, copy->data, cap);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_PACK], pack_start);
+  if (size == 0) {
+    free(copy);
+    __atomic_store_n(&arena->touched[page], clock, __ATOMIC_RELAXED);
+    return;
+  }
+  packed_page* shrunk = realloc(copy, sizeof(packed_page) + size);
+  if (shrunk != NULL) {
+    copy = shrunk;
+  }
+  copy->size = size;
+  unshare_pages(arena, start, page_size);
+  release_pages(arena, start, page_size);
+  store_packed(arena, page, copy);
+  count_packed(arena, 1, sizeof(packed_page) + size);
+}
+// Aruncă copia comprimată a paginii page, dacă există.
+static packed_page* drop_packed(arena_t* arena, uint64_t page) {
+  packed_page* copy = load_packed(arena, page);
+  if (copy != NULL) {
+    store_packed(arena, page, NULL);
+    count_packed(arena, -(uint64_t)1, -(sizeof(packed_page) + copy->size));
+  }
+  return copy;
+}
+// Readuce în arenă pagina page, dacă e comprimată. Clonele au primit copii
+// private ale paginii când a fost comprimată, deci nu mai e nimic de
+// despărțit.
+static void inflate_page(arena_t* arena, uint64_t page) {
+  packed_page* copy = drop_packed(arena, page);
+  if (copy == NULL) {
+    return;
+  }
+  VMA_TIMER_START(inflate_start);
+  lz_unpack(copy->data, (uint8_t*)arena->data + (page << arena->page_shift),
+            (size_t)1 << arena->page_shift);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_INFLATE], inflate_start);
+  free(copy);
+}
+// Marchează paginile din [address, address + size) ca accesate și le
+// decomprimă pe cele comprimate, care cer shard-urile luate exclusiv.
+static void touch_pages(arena_t* arena, uint64_t address, uint64_t size) {
+  if (arena->touched == NULL || size == 0) {
+    return;
+  }
+  uint64_t clock = __atomic_load_n(&arena->clock, __ATOMIC_RELAXED);
+  uint64_t last = (address + size - 1) >> arena->page_shift;
+  for (uint64_t page = address >> arena->page_shift; page <= last; page++) {
+    inflate_page(arena, page);
+    __atomic_store_n(&arena->touched[page], clock, __ATOMIC_RELAXED);
+  }
+}
+static int has_packed(const arena_t* arena, uint64_t address, uint64_t size) {
+  if (__atomic_load_n(&arena->packed_pages, __ATOMIC_RELAXED) == 0 ||
+      size == 0) {
+    return 0;
+  }
+  uint64_t last = (address + size - 1) >> arena->page_shift;
+  for (uint64_t page = address >> arena->page_shift; page <= last; page++) {
+    if (load_packed(arena, page) != NULL) {
+      return 1;
+    }
+  }
+  return 0;
+}
+// Ca lock_shards, pentru un transfer. Dacă zona are pagini comprimate, un
+// acces partajat își reia shard-urile exclusiv, ca să le decomprimeze; cât
+// timp le ține partajat, nicio pagină nu poate fi comprimată.
+static uint64_t lock_data(arena_t* arena, uint64_t address, uint64_t size,
+                          int exclusive) {
+  uint64_t shards = lock_shards(arena, address, size, exclusive);
+  if (!exclusive && has_packed(arena, address, size)) {
+    unlock_shards(arena, shards);
+    shards = lock_shards(arena, address, size, 1);
+  }
+  touch_pages(arena, address, size);
+  return shards;
+}
+static uint64_t table_size(const arena_t* arena, size_t entry) {
+  return ((arena->arena_size >> arena->page_shift) + 1) * entry;
+}
+static void* map_table(const arena_t* arena, size_t entry) {
+  void* table = mmap(NULL, table_size(arena, entry), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return table != MAP_FAILED ? table : NULL;
+}
+// Decomprimă (inflate) sau aruncă toate copiile comprimate, cu structura
+// luată exclusiv. Paginile comprimate sunt printre cele scrise.
+static void unpack_all(arena_t* arena, int inflate) {
+  if (arena->packed == NULL || arena->committed == NULL) {
+    return;
+  }
+  const uint64_t pages = (arena->arena_size >> arena->page_shift) + 1;
+  for (uint64_t page = 0; page < pages && arena->packed_pages != 0; page++) {
+    if (arena->committed[page / 64] >> (page % 64) == 0) {
+      page = (page / 64 + 1) * 64 - 1;
+    } else if (inflate) {
+      inflate_page(arena, page);
+    } else {
+      free(drop_packed(arena, page));
+    }
+  }
+}
+// Numără o operație și continuă trecerea de compresie cu cel mult PACK_STEP
+// pagini de la pack_cursor, comprimând paginile scrise neaccesate de cel
+// puțin pack_after operații. Un cuvânt gol din bitmap e un singur pas, așa
+// că o operație costă la fel oricât de mare ar fi arena. Trecerea o face un
+// singur fir odată, luând pe rând shard-ul fiecărei pagini.
+static void pack_cold_pages(arena_t* arena) {
+  if (arena->pack_after == 0) {
+    return;
+  }
+  uint64_t clock = __atomic_add_fetch(&arena->clock, 1, __ATOMIC_RELAXED);
+  if (arena->committed == NULL ||
+      __atomic_exchange_n(&arena->packing, 1, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  const unsigned int shift = arena->page_shift;
+  const uint64_t pages = (arena->arena_size + ((uint64_t)1 << shift) - 1) >>
+                         shift;
+  uint64_t page = arena->pack_cursor;
+  for (unsigned int step = 0; step < PACK_STEP; step++, page++) {
+    if (page >= pages) {
+      page = 0;
+    }
+    uint64_t word = load_word(&arena->committed[page / 64]);
+    if (word >> (page % 64) == 0) {
+      page = (page / 64 + 1) * 64 - 1;
+      continue;
+    }
+    if (!((word >> (page % 64)) & 1) || load_packed(arena, page) != NULL ||
+        !page_cold(arena, clock, page)) {
+      continue;
+    }
+    uint64_t shards = lock_shards(arena, page << shift, 1, 1);
+    if (page_committed(arena, page) && load_packed(arena, page) == NULL &&
+        page_cold(arena, clock, page)) {
+      pack_page(arena, page, clock);
+    }
+    unlock_shards(arena, shards);
+  }
+  arena->pack_cursor = page;
+  __atomic_store_n(&arena->packing, 0, __ATOMIC_RELEASE);
+}
+// Sfârșitul unei operații pe arenă: ceasul compresiei avansează înainte de
+// eliberarea structurii.
+static void end_operation(arena_t* arena) {
+  pack_cold_pages(arena);
+  unlock_structure(arena);
+}
+// Golește zona eliberată [address, address + size), care face acum parte
+// din zona liberă [free_start, free_end). Paginile scrise cuprinse în
+// întregime în zona liberă sunt date înapoi sistemului, cu tot cu copiile
+// lor comprimate; din cele de la margini, folosite și de alte miniblock-uri,
+// sunt puși pe zero doar octeții eliberați. Astfel, o zonă realocată se
+// citește mereu ca zerouri.
+static void discard_pages(arena_t* arena, uint64_t address, uint64_t size,
+                          uint64_t free_start, uint64_t free_end) {
+  const unsigned int shift = arena->page_shift;
+  const uint64_t page_size = (uint64_t)1 << shift;
+  uint64_t page = address >> shift;
+  uint64_t last = (address + size - 1) >> shift;
+  uint64_t removed = 0;
+  unshare_pages(arena, address, size);
+  while (page <= last) {
+    uint64_t word = arena->committed[page / 64];
+    if (word >> (page % 64) == 0) {
+      page = (page / 64 + 1) * 64;
+      continue;
+    }
+    if (!((word >> (page % 64)) & 1)) {
+      page++;
+      continue;
+    }
+    uint64_t start = page << shift;
+    if (start >= free_start && start + page_size <= free_end) {
+      // Pagini scrise consecutive, eliberate printr-un singur apel.
+      uint64_t run = page;
+      while (run + 1 <= last && page_committed(arena, run + 1) &&
+             ((run + 2) << shift) <= free_end) {
+        run++;
+      }
+      release_pages(arena, start, (run - page + 1) << shift);
+      for (uint64_t p = page; p <= run; p++) {
+        arena->committed[p / 64] &= ~((uint64_t)1 << (p % 64));
+        free(drop_packed(arena, p));
+      }
+      removed += run - page + 1;
+      page = run + 1;
+    } else {
+      uint64_t from = start > address ? start : address;
+      uint64_t to = start + page_size < address + size ? start + page_size
+                                                        : address + size;
+      inflate_page(arena, page);
+      memset(arena->data + from, 0, to - from);
+      page++;
+    }
+  }
+  arena->committed_pages -= removed;
+}
+
+static void free_mem_block(arena_t* arena, block_t* block) {
+  if (arena->cursor == block) {
+    STORE_CURSOR(arena->cursor, NULL);
+  }
+  pool_free(&arena->block_pool, block);
+}
+static void free_mem_miniblock(arena_t* arena, miniblock_t* miniblock) {
+  if (arena->miniblock_cursor == miniblock) {
+    STORE_CURSOR(arena->miniblock_cursor, NULL);
+  }
+  pool_free(&arena->miniblock_pool, miniblock);
+}
+static vma_status check_memory(list_t* list, uint64_t start_address,
+                               size_t size, arena_t* arena) {
+  if (start_address >= arena->arena_size) {
+    return VMA_OUTSIDE_ARENA;
+  }
+  if (start_address + size > arena->arena_size) {
+    return VMA_END_PAST_ARENA;
+  }
+  block_t* prev = find_block(arena, start_address);
+  block_t* next = prev != NULL ? prev->next : list->head;
+  if ((prev != NULL && prev->start_address + prev->size > start_address) ||
+      (next != NULL && start_address + size > next->start_address)) {
+    return VMA_ALREADY_ALLOCATED;
+  }
+  return VMA_OK;
+}
+static miniblock_t* create_miniblock(arena_t* arena, uint64_t start_address,
+                                     size_t size) {
+  miniblock_t* aux = pool_alloc(&arena->miniblock_pool);
+  if (aux == NULL) {
+    return NULL;
+  }
+  aux->start_address = start_address;
+  aux->size = size;
+  aux->next = NULL;
+  aux->prev = NULL;
+  aux->left = NULL;
+  aux->right = NULL;
+  aux->priority = next_priority(arena);
+  aux->count = 1;
+  aux->perm = VMA_PROT_READ | VMA_PROT_WRITE;
+  aux->perm_all = aux->perm;
+  return aux;
+}
+static unsigned int mtree_count(const miniblock_t* node) {
+  return node != NULL ? node->count : 0;
+}
+static uint8_t mtree_perm(const miniblock_t* node) {
+  return node != NULL ? node->perm_all
+                      : VMA_PROT_READ | VMA_PROT_WRITE | VMA_PROT_EXEC;
+}
+static void mtree_update(miniblock_t* node) {
+  node->count = 1 + mtree_count(node->left) + mtree_count(node->right);
+  node->perm_all =
+      node->perm & mtree_perm(node->left) & mtree_perm(node->right);
+}
+// Separă primele rank miniblock-uri. Tăierea se face după poziție, nu după
+// adresă: miniblock-urile goale au aceeași adresă ca vecinul lor.
+static void split_mtree(miniblock_t* root, unsigned int rank,
+                        miniblock_t** left, miniblock_t** right) {
+  if (root == NULL) {
+    *left = NULL;
+    *right = NULL;
+  } else if (mtree_count(root->left) < rank) {
+    split_mtree(root->right, rank - mtree_count(root->left) - 1,
+                &root->right, right);
+    mtree_update(root);
+    *left = root;
+  } else {
+    split_mtree(root->left, rank, left, &root->left);
+    mtree_update(root);
+    *right = root;
+  }
+}
+// Poziția miniblock-ului în lista blocului, în O(log k).
+static unsigned int mtree_rank(const miniblock_t* root,
+                               const miniblock_t* miniblock) {
+  unsigned int rank = 0;
+  while (root != NULL) {
+    if (root->start_address < miniblock->start_address) {
+      rank += mtree_count(root->left) + 1;
+      root = root->right;
+    } else {
+      root = root->left;
+    }
+  }
+  for (const miniblock_t* prev = miniblock->prev;
+       prev != NULL && prev->start_address == miniblock->start_address;
+       prev = prev->prev) {
+    rank++;
+  }
+  return rank;
+}
+static miniblock_t* merge_mtree(miniblock_t* left, miniblock_t* right) {
+  if (left == NULL) {
+    return right;
+  }
+  if (right == NULL) {
+    return left;
+  }
+  if (left->priority > right->priority) {
+    left->right = merge_mtree(left->right, right);
+    mtree_update(left);
+    return left;
+  }
+  right->left = merge_mtree(left, right->left);
+  mtree_update(right);
+  return right;
+}
+// Miniblock-ul nevid care conține address, căutat doar lângă cursor, sau
+// NULL. Un astfel de miniblock e în blocul care conține address, oricare ar
+// fi fost blocul cursorului.
+static miniblock_t* near_miniblock(arena_t* arena, uint64_t address) {
+  miniblock_t* cursor = LOAD_CURSOR(arena->miniblock_cursor);
+  miniblock_t* curr = cursor;
+  for (int step = 0; curr != NULL && step <= CURSOR_STEPS; step++) {
+    if (address < curr->start_address) {
+      curr = curr->prev;
+    } else if (address - curr->start_address >= curr->size) {
+      curr = curr->next;
+    } else {
+      if (curr != cursor) {
+        STORE_CURSOR(arena->miniblock_cursor, curr);
+      }
+      return curr;
+    }
+  }
+  return NULL;
+}
+// Singurul miniblock care începe la adresa lui (un miniblock gol poate avea
+// aceeași adresă de început ca vecinul lui).
+static int starts_alone(const miniblock_t* miniblock) {
+  return miniblock->prev == NULL ||
+         miniblock->prev->start_address != miniblock->start_address;
+}
+// Miniblock-ul care începe exact la address, sau NULL. Dintre mai multe
+// care încep acolo (cele goale și, poate, unul nevid) îl alege pe ultimul,
+// indiferent de forma treap-ului.
+static miniblock_t* find_miniblock(arena_t* arena, const miniblock_list* list,
+                                   uint64_t address) {
+  miniblock_t* near = near_miniblock(arena, address);
+  if (near != NULL && near->start_address == address) {
+    VMA_STAT_ADD(arena, miniblock_hits, 1);
+    return near;
+  }
+  VMA_STAT_ADD(arena, miniblock_misses, 1);
+  miniblock_t* curr = list->root;
+  miniblock_t* found = NULL;
+  uint64_t visited = 0;
+  while (curr != NULL) {
+    visited++;
+    if (curr->start_address <= address) {
+      found = curr;
+      curr = curr->right;
+    } else {
+      curr = curr->left;
+    }
+  }
+  VMA_STAT_ADD(arena, nodes_visited, visited);
+  if (found == NULL || found->start_address != address) {
+    return NULL;
+  }
+  STORE_CURSOR(arena->miniblock_cursor, found);
+  return found;
+}
+static void remove_block(list_t* list, block_t* block) {
+  if (block->prev != NULL) {
+    block->prev->next = block->next;
+  } else {
+    list->head = block->next;
+  }
+  if (block->next != NULL) {
+    block->next->prev = block->prev;
+  } else {
+    list->last = block->prev;
+  }
+  list->root = erase_from_index(list->root, block);
+  list->size--;
+}
+// Lipește miniblock-ul de blocurile vecine, dacă are. Întoarce 1 dacă nu are
+// niciun vecin și trebuie pus într-un bloc nou.
+static int check_neighbors(arena_t* arena, miniblock_t* aux) {
+  list_t* list = arena->alloc_list;
+  uint64_t start_address = aux->start_address;
+  size_t size = aux->size;
+  block_t* prev = find_block(arena, start_address);
+  block_t* next = prev != NULL ? prev->next : list->head;
+  int left = prev != NULL && prev->start_address + prev->size == start_address;
+  int right = next != NULL && next->start_address == start_address + size;
+  if (!left && !right) {
+    return 1;
+  }
+  VMA_STAT_ADD(arena, merges, left + right);
+  if (left) {
+    miniblock_list* mlist = &prev->miniblocks;
+    mlist->last->next = aux;
+    aux->prev = mlist->last;
+    mlist->last = aux;
+    mlist->root = merge_mtree(mlist->root, aux);
+    mlist->size++;
+    prev->size += size;
+    if (right) {
+      miniblock_list* next_mlist = &next->miniblocks;
+      aux->next = next_mlist->head;
+      next_mlist->head->prev = aux;
+      mlist->last = next_mlist->last;
+      mlist->root = merge_mtree(mlist->root, next_mlist->root);
+      mlist->size += next_mlist->size;
+      prev->size += next->size;
+      remove_block(list, next);
+      free_mem_block(arena, next);
+    }
+  } else {
+    miniblock_list* mlist = &next->miniblocks;
+    aux->next = mlist->head;
+    mlist->head->prev = aux;
+    mlist->head = aux;
+    mlist->root = merge_mtree(aux, mlist->root);
+    mlist->size++;
+    next->start_address = start_address;
+    next->size += size;
+  }
+  return 0;
+}
+static block_t* create_block(arena_t* arena, const uint64_t start_address,
+                             size_t size) {
+  block_t* block = pool_alloc(&arena->block_pool);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->start_address = start_address;
+  block->size = size;
+  block->miniblocks.head = NULL;
+  block->miniblocks.last = NULL;
+  block->miniblocks.root = NULL;
+  block->miniblocks.size = 0;
+  block->next = NULL;
+  block->prev = NULL;
+  block->left = NULL;
+  block->right = NULL;
+  block->priority = next_priority(arena);
+
+  return block;
+}
+// Inserează blocul imediat după prev (la începutul listei dacă prev e NULL).
+static void add_block(list_t* list, block_t* block, block_t* prev) {
+  block->prev = prev;
+  block->next = prev != NULL ? prev->next : list->head;
+  if (block->next != NULL) {
+    block->next->prev = block;
+  } else {
+    list->last = block;
+  }
+  if (prev != NULL) {
+    prev->next = block;
+  } else {
+    list->head = block;
+  }
+  insert_in_index(list, block);
+  list->size++;
+}
+static vma_status insert_zone(arena_t* arena, const uint64_t start_address,
+                              const uint64_t size) {
+  VMA_TIMER_START(check_start);
+  vma_status status =
+      check_memory(arena->alloc_list, start_address, size, arena);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_CHECK_MEMORY], check_start);
+  if (status != VMA_OK) {
+    return status;
+  }
+  if (!reserve_arena_data(arena)) {
+    return VMA_NO_MEMORY;
+  }
+  // Nodul pentru eventuala bucată din dreapta a zonei libere e alocat
+  // înainte de a modifica arena.
+  extent_t* spare = create_extent(arena);
+  if (spare == NULL) {
+    return VMA_NO_MEMORY;
+  }
+  miniblock_t* miniblock = create_miniblock(arena, start_address, size);
+  if (miniblock == NULL) {
+    pool_free(&arena->extent_pool, spare);
+    return VMA_NO_MEMORY;
+  }
+  VMA_TIMER_START(neighbors_start);
+  int isolated = check_neighbors(arena, miniblock);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_CHECK_NEIGHBORS], neighbors_start);
+  if (isolated) {
+    block_t* block = create_block(arena, start_address, size);
+    if (block == NULL) {
+      free_mem_miniblock(arena, miniblock);
+      pool_free(&arena->extent_pool, spare);
+      return VMA_NO_MEMORY;
+    }
+    miniblock_list* mlist = &block->miniblocks;
+    mlist->head = miniblock;
+    mlist->last = miniblock;
+    mlist->root = miniblock;
+    mlist->size = 1;
+    add_block(arena->alloc_list, block, find_block(arena, start_address));
+  }
+  if (size != 0) {
+    take_extent(arena, start_address, size, &spare);
+  }
+  if (spare != NULL) {
+    pool_free(&arena->extent_pool, spare);
+  }
+  arena->free_size -= size;
+  arena->no_miniblocks++;
+  return VMA_OK;
+}
+// Scoate miniblock-ul din bloc, oriunde s-ar afla, și își leagă vecinii
+// între ei. Dacă era primul, blocul începe de la următorul.
+static miniblock_t* remove_miniblock(block_t* block, miniblock_t* miniblock) {
+  miniblock_list* list = &block->miniblocks;
+  miniblock_t *left, *right, *rest;
+  split_mtree(list->root, mtree_rank(list->root, miniblock), &left, &right);
+  split_mtree(right, 1, &right, &rest);
+  list->root = merge_mtree(left, rest);
+  if (miniblock->prev == NULL) {
+    list->head = miniblock->next;
+    if (list->head != NULL) {
+      block->start_address = list->head->start_address;
+    }
+  } else {
+    miniblock->prev->next = miniblock->next;
+  }
+  if (miniblock->next == NULL) {
+    list->last = miniblock->prev;
+  } else {
+    miniblock->next->prev = miniblock->prev;
+  }
+  list->size--;
+  block->size -= miniblock->size;
+  return miniblock;
+}
+// Miniblock-urile de după cel eliberat trec în new_block. Cum miniblock-urile
+// unui bloc sunt adiacente, dimensiunea noului bloc se deduce din adrese, iar
+// numărul lor din subarborele rămas după split.
+static miniblock_t* split_block(arena_t* arena, block_t* block,
+                                miniblock_t* miniblock, block_t* new_block) {
+  miniblock_list* mlist = &block->miniblocks;
+  miniblock_t *left, *right, *rest;
+  split_mtree(mlist->root, mtree_rank(mlist->root, miniblock), &left, &right);
+  split_mtree(right, 1, &right, &rest);
+  new_block->start_address = miniblock->next->start_address;
+  new_block->size =
+      block->start_address + block->size - new_block->start_address;
+  miniblock_list* new_mlist = &new_block->miniblocks;
+  new_mlist->head = miniblock->next;
+  new_mlist->head->prev = NULL;
+  new_mlist->last = mlist->last;
+  new_mlist->root = rest;
+  new_mlist->size = mtree_count(rest);
+  add_block(arena->alloc_list, new_block, block);
+  mlist->last = miniblock->prev;
+  mlist->last->next = NULL;
+  mlist->root = left;
+  mlist->size = mtree_count(left);
+  block->size = miniblock->start_address - block->start_address;
+  return miniblock;
+}
+// AND-ul permisiunilor miniblock-urilor cu adresa >= from, respectiv < to,
+// din subarbore. Subarborii aflați în întregime în interval contribuie
+// direct cu perm_all, deci fiecare coboară pe un singur drum.
+static uint8_t perm_from(const miniblock_t* node, uint64_t from) {
+  uint8_t perm = mtree_perm(NULL);
+  while (node != NULL) {
+    if (node->start_address >= from) {
+      perm &= node->perm & mtree_perm(node->right);
+      node = node->left;
+    } else {
+      node = node->right;
+    }
+  }
+  return perm;
+}
+static uint8_t perm_until(const miniblock_t* node, uint64_t to) {
+  uint8_t perm = mtree_perm(NULL);
+  while (node != NULL) {
+    if (node->start_address < to) {
+      perm &= node->perm & mtree_perm(node->left);
+      node = node->right;
+    } else {
+      node = node->left;
+    }
+  }
+  return perm;
+}
+// Permisiunile comune miniblock-urilor care încep în [from, to), în
+// O(log k): se coboară până la nodul care desparte intervalul.
+static uint8_t perm_range(const miniblock_t* node, uint64_t from,
+                          uint64_t to) {
+  while (node != NULL) {
+    if (node->start_address < from) {
+      node = node->right;
+    } else if (node->start_address >= to) {
+      node = node->left;
+    } else {
+      return node->perm & perm_from(node->left, from) &
+             perm_until(node->right, to);
+    }
+  }
+  return mtree_perm(NULL);
+}
+// Ultimul miniblock care începe la o adresă <= address.
+static miniblock_t* floor_miniblock(const miniblock_list* list,
+                                    uint64_t address) {
+  miniblock_t* curr = list->root;
+  miniblock_t* found = NULL;
+  while (curr != NULL) {
+    if (curr->start_address <= address) {
+      found = curr;
+      curr = curr->right;
+    } else {
+      curr = curr->left;
+    }
+  }
+  return found;
+}
+// Recalculează agregatele pe drumul până la miniblock-ul de pe poziția rank.
+static void refresh_mtree(miniblock_t* root, unsigned int rank) {
+  unsigned int left = mtree_count(root->left);
+  if (rank < left) {
+    refresh_mtree(root->left, rank);
+  } else if (rank > left) {
+    refresh_mtree(root->right, rank - left - 1);
+  }
+  mtree_update(root);
+}
+// Blocul care conține adresa, sau NULL dacă adresa nu e alocată.
+static block_t* find_block_containing(arena_t* arena, uint64_t address) {
+  block_t* block = find_block(arena, address);
+  if (block == NULL || address >= block->start_address + block->size) {
+    return NULL;
+  }
+  return block;
+}
+vma_status alloc_block(arena_t* arena, const uint64_t start_address,
+                       const uint64_t size) {
+  lock_structure(arena, 1);
+  vma_status status = insert_zone(arena, start_address, size);
+  end_operation(arena);
+  return status;
+}
+static vma_status remove_zone(arena_t* arena, const uint64_t start_address) {
+  list_t* list = arena->alloc_list;
+  block_t* curr = find_block_containing(arena, start_address);
+  if (curr == NULL) {
+    return VMA_INVALID_ADDRESS;
+  }
+  miniblock_list* mlist = &curr->miniblocks;
+  miniblock_t* aux = find_miniblock(arena, mlist, start_address);
+  if (aux == NULL) {
+    return VMA_INVALID_ADDRESS;
+  }
+  // Nodurile noului bloc și al zonei libere sunt alocate înainte de a
+  // modifica arena, ca un eșec să o lase neschimbată.
+  extent_t* spare = create_extent(arena);
+  if (spare == NULL) {
+    return VMA_NO_MEMORY;
+  }
+  miniblock_t* neighbor = aux->next != NULL ? aux->next : aux->prev;
+  // Un miniblock gol din interior nu lasă un gol, deci blocul rămâne întreg.
+  if (aux->prev != NULL && aux->next != NULL && aux->size != 0) {
+    block_t* new_block = create_block(arena, 0, 0);
+    if (new_block == NULL) {
+      pool_free(&arena->extent_pool, spare);
+      return VMA_NO_MEMORY;
+    }
+    VMA_TIMER_START(split_start);
+    split_block(arena, curr, aux, new_block);
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_SPLIT_BLOCK], split_start);
+    VMA_STAT_ADD(arena, splits, 1);
+  } else if (mlist->size == 1) {
+    // Cursorii trec la blocul următor, unde continuă un FREE_BLOCK
+    // secvențial.
+    block_t* next = curr->next != NULL ? curr->next : curr->prev;
+    remove_miniblock(curr, aux);
+    remove_block(list, curr);
+    free_mem_block(arena, curr);
+    if (next != NULL) {
+      move_cursor(arena, next);
+    }
+  } else {
+    remove_miniblock(curr, aux);
+  }
+  if (aux->size != 0) {
+    release_extent(arena, aux->start_address, aux->size, &spare);
+    extent_t* extent = find_extent(arena, aux->start_address);
+    discard_pages(arena, aux->start_address, aux->size, extent->start_address,
+                  extent->start_address + extent->size);
+  }
+  if (spare != NULL) {
+    pool_free(&arena->extent_pool, spare);
+  }
+  arena->free_size += aux->size;
+  arena->no_miniblocks--;
+  free_mem_miniblock(arena, aux);
+  if (neighbor != NULL) {
+    STORE_CURSOR(arena->miniblock_cursor, neighbor);
+  }
+  return VMA_OK;
+}
+vma_status free_block(arena_t* arena, const uint64_t start_address) {
+  lock_structure(arena, 1);
+  vma_status status = remove_zone(arena, start_address);
+  end_operation(arena);
+  return status;
+}
+static vma_status insert_any(arena_t* arena, const uint64_t size,
+                             vma_fit policy, uint64_t* address) {
+  extent_t* extent = NULL;
+  if (size == 0) {
+    return VMA_NO_FIT;
+  }
+  if (policy == VMA_FIT_BEST) {
+    extent = best_fit(arena, size);
+  } else if (policy == VMA_FIT_NEXT) {
+    extent = first_fit(arena->free_root, arena->next_fit, size);
+  }
+  if (extent == NULL && policy != VMA_FIT_BEST) {
+    extent = first_fit(arena->free_root, 0, size);
+  }
+  if (extent == NULL) {
+    return VMA_NO_FIT;
+  }
+  *address = extent->start_address;
+  vma_status status = insert_zone(arena, *address, size);
+  if (status == VMA_OK) {
+    arena->next_fit = *address + size;
+  }
+  return status;
+}
+vma_status alloc_any(arena_t* arena, const uint64_t size, vma_fit policy,
+                     uint64_t* address) {
+  lock_structure(arena, 1);
+  vma_status status = insert_any(arena, size, policy, address);
+  end_operation(arena);
+  return status;
+}
+// Verifică adresa unui transfer și îl limitează la sfârșitul blocului.
+// Miniblock-urile unui bloc sunt adiacente în arenă, deci zona rezultată
+// este continuă, oricâte miniblock-uri ar acoperi.
+static vma_status resolve_in(arena_t* arena, const block_t* block,
+                             const uint64_t address, uint64_t* size,
+                             const uint8_t perm) {
+  if (block == NULL) {
+    *size = 0;
+    return VMA_INVALID_ADDRESS;
+  }
+  vma_status status = VMA_OK;
+  if (address + *size > block->start_address + block->size) {
+    *size = block->start_address + block->size - address;
+    status = VMA_TRUNCATED;
+  }
+  // Miniblock-urile atinse sunt cel care conține address și cele care încep
+  // înainte de sfârșitul zonei.
+  // De obicei zona e în întregime în miniblock-ul de lângă cursor, care îi
+  // dă singur permisiunile.
+  const miniblock_list* mlist = &block->miniblocks;
+  uint64_t to = address + (*size != 0 ? *size : 1);
+  miniblock_t* miniblock = near_miniblock(arena, address);
+  uint8_t found;
+  if (miniblock != NULL) {
+    VMA_STAT_ADD(arena, miniblock_hits, 1);
+    found = to - miniblock->start_address <= miniblock->size &&
+                    starts_alone(miniblock)
+                ? miniblock->perm
+                : perm_range(mlist->root, miniblock->start_address, to);
+  } else {
+    VMA_STAT_ADD(arena, miniblock_misses, 1);
+    miniblock = floor_miniblock(mlist, address);
+    STORE_CURSOR(arena->miniblock_cursor, miniblock);
+    found = perm_range(mlist->root, miniblock->start_address, to);
+  }
+  if ((found & perm) != perm) {
+    *size = 0;
+    return VMA_NO_PERMISSION;
+  }
+  return status;
+}
+static vma_status resolve(arena_t* arena, const uint64_t address,
+                          uint64_t* size, const uint8_t perm) {
+  return resolve_in(arena, find_block_containing(arena, address), address,
+                    size, perm);
+}
+// Ultimul bloc care începe la o adresă <= address, pornind de la floor,
+// rezultatul pentru o adresă mai mică. Segmentele vecine cad de obicei în
+// același bloc sau în următoarele, deci indexul e parcurs doar la salturi.
+static block_t* advance_block(arena_t* arena, block_t* floor,
+                              uint64_t address) {
+  for (int step = 0; step < 3; step++) {
+    block_t* next = floor != NULL ? floor->next : arena->alloc_list->head;
+    if (next == NULL || next->start_address > address) {
+      return floor;
+    }
+    floor = next;
+  }
+  return find_block(arena, address);
+}
+static int compare_segments(const void* a, const void* b) {
+  const vma_segment* x = *(vma_segment* const*)a;
+  const vma_segment* y = *(vma_segment* const*)b;
+  return (x->address > y->address) - (x->address < y->address);
+}
+// Completează done și status pentru toate segmentele, parcurgându-le în
+// ordinea adreselor. Dacă ordinea nu poate fi alocată, fiecare segment e
+// căutat separat în index.
+static void resolve_segments(arena_t* arena, vma_segment* segments,
+                             size_t count, uint8_t perm) {
+  vma_segment* local[VMA_SEGMENTS_ON_STACK];
+  vma_segment** order = local;
+  if (count > VMA_SEGMENTS_ON_STACK) {
+    order = malloc(count * sizeof(*order));
+  }
+  if (order == NULL) {
+    for (size_t i = 0; i < count; i++) {
+      segments[i].done = segments[i].size;
+      segments[i].status =
+          resolve(arena, segments[i].address, &segments[i].done, perm);
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    order[i] = &segments[i];
+  }
+  qsort(order, count, sizeof(*order), compare_segments);
+  block_t* floor = NULL;
+  for (size_t i = 0; i < count; i++) {
+    vma_segment* segment = order[i];
+    floor = advance_block(arena, floor, segment->address);
+    block_t* block = floor;
+    if (block != NULL &&
+        segment->address >= block->start_address + block->size) {
+      block = NULL;
+    }
+    segment->done = segment->size;
+    segment->status =
+        resolve_in(arena, block, segment->address, &segment->done, perm);
+  }
+  if (order != local) {
+    free(order);
+  }
+}
+// Segmentele goale sau respinse nu ating datele arenei.
+static int transferred(const vma_segment* segment) {
+  return segment->done != 0 &&
+         (segment->status == VMA_OK || segment->status == VMA_TRUNCATED);
+}
+vma_status vma_mprotect(arena_t* arena, const uint64_t address,
+                        const uint8_t perm) {
+  lock_structure(arena, 1);
+  vma_status status = VMA_INVALID_ADDRESS;
+  block_t* block = find_block_containing(arena, address);
+  if (block != NULL) {
+    miniblock_list* mlist = &block->miniblocks;
+    miniblock_t* miniblock = find_miniblock(arena, mlist, address);
+    if (miniblock != NULL) {
+      miniblock->perm = perm;
+      refresh_mtree(mlist->root, mtree_rank(mlist->root, miniblock));
+      status = VMA_OK;
+    }
+  }
+  end_operation(arena);
+  return status;
+}
+vma_status vma_resolve(arena_t* arena, const uint64_t address, uint64_t* size,
+                       const uint8_t perm) {
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, perm);
+  unlock_structure(arena);
+  return status;
+}
+vma_status vma_last_miniblock(arena_t* arena, const uint64_t address,
+                              uint64_t* start) {
+  lock_structure(arena, 0);
+  block_t* block = find_block_containing(arena, address);
+  if (block != NULL) {
+    *start = block->miniblocks.last->start_address;
+  }
+  unlock_structure(arena);
+  return block != NULL ? VMA_OK : VMA_INVALID_ADDRESS;
+}
+static void copy_to_buffer(void* ctx, const int8_t* src, size_t size) {
+  int8_t** dst = ctx;
+  memcpy(*dst, src, size);
+  *dst += size;
+}
+vma_status vma_read(arena_t* arena, const uint64_t address, uint64_t* size,
+                    int8_t* buffer) {
+  return vma_read_to(arena, address, size, copy_to_buffer, &buffer);
+}
+vma_status vma_read_to(arena_t* arena, const uint64_t address, uint64_t* size,
+                       vma_sink_fn sink, void* ctx) {
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, VMA_PROT_READ);
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    uint64_t shards = lock_data(arena, address, *size, 0);
+    VMA_TIMER_START(copy_start);
+    read_pages(arena, address, *size, sink, ctx);
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+    VMA_STAT_ADD(arena, bytes_copied, *size);
+    unlock_shards(arena, shards);
+  }
+  end_operation(arena);
+  return status;
+}
+vma_status vma_write(arena_t* arena, const uint64_t address, uint64_t* size,
+                     const int8_t* data) {
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, VMA_PROT_WRITE);
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    uint64_t shards = lock_data(arena, address, *size, 1);
+    VMA_TIMER_START(copy_start);
+    unshare_pages(arena, address, *size);
+    commit_pages(arena, address, *size);
+    memcpy(arena->data + address, data, *size);
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+    VMA_STAT_ADD(arena, bytes_copied, *size);
+    unlock_shards(arena, shards);
+  }
+  end_operation(arena);
+  return status;
+}
+vma_status vma_write_from(arena_t* arena, const uint64_t address,
+                          uint64_t* size, vma_source_fn source, void* ctx) {
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, VMA_PROT_WRITE);
+  if (status != VMA_OK && status != VMA_TRUNCATED) {
+    end_operation(arena);
+    return status;
+  }
+  uint64_t shards = lock_data(arena, address, *size, 1);
+  VMA_TIMER_START(copy_start);
+  unshare_pages(arena, address, *size);
+  uint64_t count = 0;
+  while (count < *size) {
+    size_t got = source(ctx, arena->data + address + count, *size - count);
+    if (got == 0) {
+      break;
+    }
+    count += got;
+  }
+  commit_pages(arena, address, count);
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+  VMA_STAT_ADD(arena, bytes_copied, count);
+  unlock_shards(arena, shards);
+  end_operation(arena);
+  *size = count;
+  return status;
+}
+void vma_readv(arena_t* arena, vma_segment* segments, size_t count,
+               vma_sink_fn sink, void* ctx) {
+  lock_structure(arena, 0);
+  resolve_segments(arena, segments, count, VMA_PROT_READ);
+  VMA_TIMER_START(copy_start);
+  for (size_t i = 0; i < count; i++) {
+    if (transferred(&segments[i])) {
+      uint64_t shards =
+          lock_data(arena, segments[i].address, segments[i].done, 0);
+      read_pages(arena, segments[i].address, segments[i].done, sink, ctx);
+      unlock_shards(arena, shards);
+      VMA_STAT_ADD(arena, bytes_copied, segments[i].done);
+    }
+  }
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+  end_operation(arena);
+}
+void vma_writev(arena_t* arena, vma_segment* segments, size_t count,
+                const int8_t* data) {
+  lock_structure(arena, 0);
+  resolve_segments(arena, segments, count, VMA_PROT_WRITE);
+  VMA_TIMER_START(copy_start);
+  for (size_t i = 0; i < count; i++) {
+    if (transferred(&segments[i])) {
+      uint64_t shards =
+          lock_data(arena, segments[i].address, segments[i].done, 1);
+      unshare_pages(arena, segments[i].address, segments[i].done);
+      commit_pages(arena, segments[i].address, segments[i].done);
+      memcpy(arena->data + segments[i].address, data, segments[i].done);
+      unlock_shards(arena, shards);
+      VMA_STAT_ADD(arena, bytes_copied, segments[i].done);
+    }
+    data += segments[i].size;
+  }
+  VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+  end_operation(arena);
+}
+// Pune pe zero zona [address, address + size); paginile nescrise sunt deja
+// zerouri și rămân neatinse.
+static void zero_pages(arena_t* arena, uint64_t address, uint64_t size) {
+  uint64_t end = address + size;
+  while (address < end) {
+    int committed;
+    uint64_t next = run_end(arena, address, end, &committed);
+    if (committed) {
+      memset(arena->data + address, 0, next - address);
+    }
+    address = next;
+  }
+}
+vma_status vma_memset(arena_t* arena, const uint64_t address, uint64_t* size,
+                      const uint8_t value) {
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, VMA_PROT_WRITE);
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    uint64_t shards = lock_data(arena, address, *size, 1);
+    VMA_TIMER_START(copy_start);
+    unshare_pages(arena, address, *size);
+    if (value == 0) {
+      zero_pages(arena, address, *size);
+    } else {
+      commit_pages(arena, address, *size);
+      memset(arena->data + address, value, *size);
+    }
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+    VMA_STAT_ADD(arena, bytes_copied, *size);
+    unlock_shards(arena, shards);
+  }
+  end_operation(arena);
+  return status;
+}
+// Copiază [from, from + size) la to, pe serii de pagini: cele scrise cu
+// memmove, cele nescrise ca zerouri. Când destinația acoperă sfârșitul
+// sursei, seriile sunt parcurse de la coadă, ca să nu fie suprascrise
+// înainte de a fi copiate.
+static void copy_pages(arena_t* arena, uint64_t from, uint64_t to,
+                       uint64_t size) {
+  int backward = to > from && to < from + size;
+  unshare_pages(arena, to, size);
+  for (uint64_t done = 0; done < size;) {
+    int committed;
+    uint64_t src, n;
+    if (backward) {
+      uint64_t end = from + size - done;
+      src = run_start(arena, from, end, &committed);
+      n = end - src;
+    } else {
+      src = from + done;
+      n = run_end(arena, src, from + size, &committed) - src;
+    }
+    uint64_t dst = to + (src - from);
+    if (committed) {
+      commit_pages(arena, dst, n);
+      memmove(arena->data + dst, arena->data + src, n);
+    } else {
+      zero_pages(arena, dst, n);
+    }
+    done += n;
+  }
+}
+vma_status vma_memmove(arena_t* arena, const uint64_t dst, const uint64_t src,
+                       uint64_t* size) {
+  lock_structure(arena, 0);
+  // Întâi ambele limite, apoi permisiunile, pe zona rămasă.
+  uint64_t n = *size;
+  vma_status from = resolve(arena, src, &n, VMA_PROT_NONE);
+  vma_status to = from == VMA_OK || from == VMA_TRUNCATED
+                      ? resolve(arena, dst, &n, VMA_PROT_NONE)
+                      : from;
+  vma_status status = to;
+  if (to == VMA_OK || to == VMA_TRUNCATED) {
+    if (resolve(arena, src, &n, VMA_PROT_READ) == VMA_NO_PERMISSION ||
+        resolve(arena, dst, &n, VMA_PROT_WRITE) == VMA_NO_PERMISSION) {
+      status = VMA_NO_PERMISSION;
+      n = 0;
+    } else if (from == VMA_TRUNCATED) {
+      status = VMA_TRUNCATED;
+    }
+  }
+  *size = n;
+  if (status == VMA_OK || status == VMA_TRUNCATED) {
+    uint64_t low = src < dst ? src : dst;
+    uint64_t high = src < dst ? dst : src;
+    uint64_t shards = lock_shards(arena, low, high - low + n, 1);
+    touch_pages(arena, src, n);
+    touch_pages(arena, dst, n);
+    VMA_TIMER_START(copy_start);
+    copy_pages(arena, src, dst, n);
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+    VMA_STAT_ADD(arena, bytes_copied, n);
+    unlock_shards(arena, shards);
+  }
+  end_operation(arena);
+  return status;
+}
+#ifdef __x86_64__
+// Filtrează pozițiile [0, last] câte 32 deodată după primul și ultimul
+// octet al pattern-ului (m >= 2) și compară complet doar candidații rămași.
+// Întoarce poziția de la care căutarea trebuie continuată altfel: după
+// ultimul grup întreg de 32 sau, dacă prea mulți candidați s-au dovedit
+// falși, unde s-a renunțat. *hit primește prima apariție găsită.
+__attribute__((target("avx2"))) static size_t filter_avx2(
+    const int8_t* data, size_t last, const int8_t* pattern, size_t m,
+    const int8_t** hit) {
+  const __m256i first = _mm256_set1_epi8(pattern[0]);
+  const __m256i final = _mm256_set1_epi8(pattern[m - 1]);
+  size_t misses = 0, i = 0;
+  for (; i + 32 <= last + 1; i += 32) {
+    __m256i head = _mm256_loadu_si256((const __m256i*)(data + i));
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(data + i + m - 1));
+    unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, final)));
+    for (; mask != 0; mask &= mask - 1) {
+      unsigned int bit = __builtin_ctz(mask);
+      if (memcmp(data + i + bit + 1, pattern + 1, m - 2) == 0) {
+        *hit = data + i + bit;
+        return i;
+      }
+      misses++;
+    }
+    if (misses > FIND_MISSES + i / 32) {
+      return i + 32;
+    }
+  }
+  return i;
+}
+#endif
+// Prima apariție a lui pattern (m octeți) în [data, data + size). Pe
+// procesoarele cu AVX2, filtrul vectorial de mai sus; restul pozițiilor (și
+// datele pe care filtrul nu e eficient) trec prin memmem, liniar în cel mai
+// rău caz.
+static const int8_t* search_span(const int8_t* data, size_t size,
+                                 const int8_t* pattern, size_t m) {
+  if (size < m) {
+    return NULL;
+  }
+  if (m == 1) {
+    return memchr(data, (uint8_t)pattern[0], size);
+  }
+  size_t i = 0;
+#ifdef __x86_64__
+  if (__builtin_cpu_supports("avx2")) {
+    const int8_t* hit = NULL;
+    i = filter_avx2(data, size - m, pattern, m, &hit);
+    if (hit != NULL) {
+      return hit;
+    }
+  }
+#endif
+  return i + m <= size ? memmem(data + i, size - i, pattern, m) : NULL;
+}
+// Caută pe serii de pagini: cele scrise direct în arenă, cele nescrise doar
+// dacă pattern-ul e format din zerouri. Aparițiile care trec peste granița
+// dintre două serii sunt căutate într-o fereastră cu ultimii m - 1 octeți ai
+// seriilor anterioare și primii m - 1 ai seriei curente.
+static vma_status find_pages(arena_t* arena, uint64_t address, uint64_t size,
+                             const int8_t* pattern, uint64_t m,
+                             uint64_t* found) {
+  int8_t stack_window[2 * FIND_WINDOW];
+  int8_t* window = stack_window;
+  if (m - 1 > FIND_WINDOW) {
+    window = malloc(2 * (m - 1));
+    if (window == NULL) {
+      return VMA_NO_MEMORY;
+    }
+  }
+  int zeros = 1;
+  for (uint64_t i = 0; i < m; i++) {
+    zeros &= pattern[i] == 0;
+  }
+  uint64_t kept = 0, end = address + size;
+  for (uint64_t start = address; start < end && *found == VMA_NOT_FOUND;) {
+    int committed;
+    uint64_t next = run_end(arena, start, end, &committed);
+    uint64_t len = next - start;
+    uint64_t k = len < m - 1 ? len : m - 1;
+    if (committed) {
+      memcpy(window + kept, arena->data + start, k);
+    } else {
+      memset(window + kept, 0, k);
+    }
+    const int8_t* hit = search_span(window, kept + k, pattern, m);
+    if (hit != NULL && (uint64_t)(hit - window) < kept) {
+      *found = start - kept + (hit - window);
+    } else if (committed) {
+      hit = search_span(arena->data + start, len, pattern, m);
+      if (hit != NULL) {
+        *found = hit - arena->data;
+      }
+    } else if (zeros && len >= m) {
+      *found = start;
+    }
+    if (len >= m - 1) {
+      if (committed) {
+        memcpy(window, arena->data + next - (m - 1), m - 1);
+      } else {
+        memset(window, 0, m - 1);
+      }
+      kept = m - 1;
+    } else {
+      uint64_t keep = kept + len < m - 1 ? kept + len : m - 1;
+      memmove(window, window + kept + len - keep, keep);
+      kept = keep;
+    }
+    start = next;
+  }
+  if (window != stack_window) {
+    free(window);
+  }
+  return VMA_OK;
+}
+vma_status vma_find(arena_t* arena, const uint64_t address, uint64_t* size,
+                    const int8_t* pattern, const uint64_t length,
+                    uint64_t* found) {
+  *found = VMA_NOT_FOUND;
+  lock_structure(arena, 0);
+  vma_status status = resolve(arena, address, size, VMA_PROT_READ);
+  if ((status == VMA_OK || status == VMA_TRUNCATED) && length == 0) {
+    *found = address;
+  } else if ((status == VMA_OK || status == VMA_TRUNCATED) &&
+             length <= *size) {
+    uint64_t shards = lock_data(arena, address, *size, 0);
+    VMA_TIMER_START(copy_start);
+    vma_status searched =
+        find_pages(arena, address, *size, pattern, length, found);
+    if (searched != VMA_OK) {
+      status = searched;
+    }
+    VMA_TIMER_STOP(arena, phases[VMA_PHASE_COPY], copy_start);
+    unlock_shards(arena, shards);
+  }
+  end_operation(arena);
+  return status;
+}
+// Mută [from, from + size) la to < from. Bucățile din pagini scrise sunt
+// copiate în bloc și marchează destinația ca scrisă; cele din pagini nescrise
+// sunt zerouri, deci sunt copiate doar peste pagini deja scrise, fără a
+// materializa restul destinației.
+static void move_pages(arena_t* arena, uint64_t from, uint64_t to,
+                       uint64_t size) {
+  const unsigned int shift = arena->page_shift;
+  const uint64_t page_mask = ((uint64_t)1 << shift) - 1;
+  uint64_t done = 0;
+  unshare_pages(arena, to, size);
+  while (done < size) {
+    uint64_t src = from + done, dst = to + done;
+    uint64_t n = (page_mask + 1) - (src & page_mask);
+    int committed = page_committed(arena, src >> shift);
+    if (committed) {
+      while (done + n < size && page_committed(arena, (src + n) >> shift)) {
+        n += page_mask + 1;
+      }
+    } else if ((page_mask + 1) - (dst & page_mask) < n) {
+      n = (page_mask + 1) - (dst & page_mask);
+    }
+    if (n > size - done) {
+      n = size - done;
+    }
+    if (committed) {
+      memmove(arena->data + dst, arena->data + src, n);
+      commit_pages(arena, dst, n);
+    } else if (page_committed(arena, dst >> shift)) {
+      memmove(arena->data + dst, arena->data + src, n);
+    }
+    done += n;
+  }
+}
+static double fragmentation(const arena_t* arena) {
+  if (arena->free_size == 0) {
+    return 0;
+  }
+  return 1.0 - (double)extent_max(arena->free_root) / arena->free_size;
+}
+double vma_fragmentation(arena_t* arena) {
+  lock_structure(arena, 0);
+  double ratio = fragmentation(arena);
+  unlock_structure(arena);
+  return ratio;
+}
+uint64_t vma_metadata_size(arena_t* arena) {
+  lock_structure(arena, 0);
+  uint64_t size = arena->alloc_list->size * arena->block_pool.node_size +
+                  arena->no_miniblocks * arena->miniblock_pool.node_size;
+  unlock_structure(arena);
+  return size;
+}
+vma_status vma_set_compression(arena_t* arena, uint64_t idle_ops) {
+  lock_structure(arena, 1);
+  vma_status status = VMA_OK;
+  if (idle_ops != 0 && arena->packed == NULL) {
+    arena->packed = map_table(arena, sizeof(packed_page*));
+    arena->touched = map_table(arena, sizeof(uint64_t));
+    if (arena->packed == NULL || arena->touched == NULL) {
+      if (arena->packed != NULL) {
+        munmap(arena->packed, table_size(arena, sizeof(packed_page*)));
+      }
+      if (arena->touched != NULL) {
+        munmap(arena->touched, table_size(arena, sizeof(uint64_t)));
+      }
+      arena->packed = NULL;
+      arena->touched = NULL;
+      status = VMA_NO_MEMORY;
+    }
+  }
+  if (status == VMA_OK) {
+    if (idle_ops == 0) {
+      unpack_all(arena, 1);
+    }
+    arena->pack_after = idle_ops;
+  }
+  unlock_structure(arena);
+  return status;
+}
+// Lipește blocurile unul după altul de la adresa 0, în ordinea adreselor.
+// Fiind adiacente, ele devin un singur bloc, iar spațiul liber o singură
+// zonă, la sfârșitul arenei.
+void vma_compact(arena_t* arena, vma_relocate_fn relocate, void* ctx,
+                 vma_compact_report* report) {
+  lock_structure(arena, 1);
+  uint64_t start = vma_now_ns();
+  report->blocks_moved = 0;
+  report->bytes_moved = 0;
+  report->fragmentation_before = fragmentation(arena);
+  list_t* list = arena->alloc_list;
+  block_t* first = list->head;
+  miniblock_list* first_mlist = first != NULL ? &first->miniblocks : NULL;
+  uint64_t cursor = 0;
+  for (block_t* block = first; block != NULL;) {
+    block_t* next = block->next;
+    miniblock_list* mlist = &block->miniblocks;
+    if (block->start_address != cursor) {
+      uint64_t delta = block->start_address - cursor;
+      touch_pages(arena, block->start_address, block->size);
+      touch_pages(arena, cursor, block->size);
+      move_pages(arena, block->start_address, cursor, block->size);
+      for (miniblock_t* m = mlist->head; m != NULL; m = m->next) {
+        m->start_address -= delta;
+      }
+      if (relocate != NULL) {
+        relocate(ctx, block->start_address, cursor, block->size);
+      }
+      block->start_address = cursor;
+      report->blocks_moved++;
+      report->bytes_moved += block->size;
+    }
+    cursor += block->size;
+    if (block != first) {
+      first_mlist->last->next = mlist->head;
+      mlist->head->prev = first_mlist->last;
+      first_mlist->last = mlist->last;
+      first_mlist->root = merge_mtree(first_mlist->root, mlist->root);
+      first_mlist->size += mlist->size;
+      free_mem_block(arena, block);
+    }
+    block = next;
+  }
+  if (first != NULL) {
+    first->size = cursor;
+    first->next = NULL;
+    first->left = NULL;
+    first->right = NULL;
+    list->head = first;
+    list->last = first;
+    list->root = first;
+    list->size = 1;
+    // Nodurile zonelor libere se întorc în pool, deci crearea celei rămase
+    // nu poate eșua.
+    for (extent_t* extent = arena->free_head; extent != NULL;) {
+      extent_t* next = extent->next;
+      pool_free(&arena->extent_pool, extent);
+      extent = next;
+    }
+    arena->free_root = NULL;
+    arena->free_head = NULL;
+    memset(arena->free_buckets, 0, sizeof(arena->free_buckets));
+    arena->free_mask = 0;
+    arena->next_fit = cursor;
+    if (cursor < arena->arena_size) {
+      discard_pages(arena, cursor, arena->arena_size - cursor, cursor,
+                    arena->arena_size);
+      extent_t* extent = create_extent(arena);
+      extent->start_address = cursor;
+      extent->size = arena->arena_size - cursor;
+      insert_extent(arena, extent, NULL);
+    }
+  }
+  report->fragmentation_after = fragmentation(arena);
+  report->duration_ns = vma_now_ns() - start;
+  end_operation(arena);
+}
+// Caută, de la pagina *page, următoarea serie de pagini scrise și întoarce
+// în [*start, *end) adresele ei, limitate la arenă; 0 dacă nu mai există.
+static int next_committed_run(const arena_t* arena, uint64_t* page,
+                              uint64_t* start, uint64_t* end) {
+  const unsigned int shift = arena->page_shift;
+  const uint64_t pages = (arena->arena_size + (((uint64_t)1 << shift) - 1)) >>
+                         shift;
+  while (*page < pages && !page_committed(arena, *page)) {
+    *page += 1;
+  }
+  if (*page >= pages) {
+    return 0;
+  }
+  *start = *page << shift;
+  while (*page < pages && page_committed(arena, *page)) {
+    *page += 1;
+  }
+  *end = *page << shift;
+  if (*end > arena->arena_size) {
+    *end = arena->arena_size;
+  }
+  return 1;
+}
+// Alocă din nou un miniblock al unei arene salvate sau clonate, cu
+// permisiunile lui.
+static vma_status restore_miniblock(arena_t* arena, uint64_t start_address,
+                                    uint64_t size, uint8_t perm) {
+  vma_status status = insert_zone(arena, start_address, size);
+  if (status == VMA_OK) {
+    miniblock_list* mlist = &find_block(arena, start_address)->miniblocks;
+    miniblock_t* miniblock = find_miniblock(arena, mlist, start_address);
+    miniblock->perm = perm;
+    refresh_mtree(mlist->root, mtree_rank(mlist->root, miniblock));
+  }
+  return status;
+}
+static int write_snapshot(arena_t* arena, FILE* file) {
+  snapshot_header header;
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.arena_size = arena->arena_size;
+  header.miniblocks = arena->no_miniblocks;
+  header.page_shift = arena->page_shift;
+  header.bitmap_offset = page_align(
+      arena, sizeof(header) + header.miniblocks * sizeof(snapshot_miniblock));
+  header.data_offset =
+      page_align(arena, header.bitmap_offset + bitmap_size(arena));
+  fwrite(&header, sizeof(header), 1, file);
+  for (block_t* block = arena->alloc_list->head; block != NULL;
+       block = block->next) {
+    miniblock_t* miniblock = block->miniblocks.head;
+    for (; miniblock != NULL; miniblock = miniblock->next) {
+      snapshot_miniblock entry = {miniblock->start_address, miniblock->size,
+                                  miniblock->perm};
+      fwrite(&entry, sizeof(entry), 1, file);
+    }
+  }
+  if (arena->data != NULL) {
+    fseeko(file, header.bitmap_offset, SEEK_SET);
+    fwrite(arena->committed, 1, bitmap_size(arena), file);
+    // Paginile scrise consecutive, cu câte un singur fwrite.
+    uint64_t page = 0, start, end;
+    while (next_committed_run(arena, &page, &start, &end)) {
+      fseeko(file, header.data_offset + start, SEEK_SET);
+      fwrite(arena->data + start, 1, end - start, file);
+    }
+  }
+  if (fflush(file) != 0 ||
+      ftruncate(fileno(file), header.data_offset + arena->arena_size) != 0) {
+    return 0;
+  }
+  return !ferror(file);
+}
+vma_status vma_save(arena_t* arena, const char* path) {
+  char* tmp = malloc(strlen(path) + sizeof(".tmp"));
+  if (tmp == NULL) {
+    return VMA_NO_MEMORY;
+  }
+  strcpy(tmp, path);
+  strcat(tmp, ".tmp");
+  lock_structure(arena, 1);
+  unpack_all(arena, 1);
+  vma_status status = VMA_IO_ERROR;
+  FILE* file = fopen(tmp, "wb");
+  if (file != NULL) {
+    int written = write_snapshot(arena, file);
+    if (fclose(file) == 0 && written && rename(tmp, path) == 0) {
+      status = VMA_OK;
+    } else {
+      unlink(tmp);
+    }
+  }
+  unlock_structure(arena);
+  free(tmp);
+  return status;
+}
+// Mapează datele și bitmap-ul din fișier și reface blocurile și zonele
+// libere din tabela de miniblock-uri.
+static vma_status read_snapshot(arena_t* arena, FILE* file,
+                                const snapshot_header* header) {
+  if (arena->arena_size != 0) {
+    int fd = fileno(file);
+    void* data = mmap(NULL, arena->arena_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_NORESERVE, fd, header->data_offset);
+    if (data == MAP_FAILED) {
+      return VMA_NO_MEMORY;
+    }
+    void* committed = mmap(NULL, bitmap_size(arena), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_NORESERVE, fd,
+                           header->bitmap_offset);
+    if (committed == MAP_FAILED) {
+      munmap(data, arena->arena_size);
+      return VMA_NO_MEMORY;
+    }
+    arena->data = data;
+    arena->committed = committed;
+    arena->mapped = 1;
+    for (uint64_t i = 0; i < bitmap_size(arena) / sizeof(uint64_t); i++) {
+      arena->committed_pages += __builtin_popcountll(arena->committed[i]);
+    }
+  }
+  for (uint64_t i = 0; i < header->miniblocks; i++) {
+    snapshot_miniblock entry;
+    if (fread(&entry, sizeof(entry), 1, file) != 1) {
+      return VMA_BAD_SNAPSHOT;
+    }
+    vma_status status =
+        restore_miniblock(arena, entry.start_address, entry.size, entry.perm);
+    if (status == VMA_NO_MEMORY) {
+      return status;
+    }
+    if (status != VMA_OK) {
+      return VMA_BAD_SNAPSHOT;
+    }
+  }
+  return VMA_OK;
+}
+vma_status vma_load(const char* path, arena_t** arena) {
+  return vma_load_in(NULL, path, arena);
+}
+vma_status vma_load_in(vma_domain* domain, const char* path,
+                       arena_t** arena) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return VMA_IO_ERROR;
+  }
+  snapshot_header header;
+  struct stat info;
+  arena_t* loaded = NULL;
+  vma_status status = VMA_BAD_SNAPSHOT;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      fstat(fileno(file), &info) != 0) {
+    status = VMA_IO_ERROR;
+  } else if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ==
+             0) {
+    loaded = alloc_arena_in(domain, header.arena_size);
+    if (loaded == NULL) {
+      status = VMA_NO_MEMORY;
+    } else if (header.page_shift == loaded->page_shift &&
+               header.bitmap_offset == page_align(loaded,
+                                                  header.bitmap_offset) &&
+               header.data_offset == page_align(loaded, header.data_offset) &&
+               header.bitmap_offset + bitmap_size(loaded) <=
+                   header.data_offset &&
+               header.data_offset + header.arena_size <=
+                   (uint64_t)info.st_size) {
+      status = read_snapshot(loaded, file, &header);
+    }
+  }
+  fclose(file);
+  if (status != VMA_OK) {
+    if (loaded != NULL) {
+      dealloc_arena(loaded);
+    }
+    return status;
+  }
+  *arena = loaded;
+  return VMA_OK;
+}
+static void unlink_clone(arena_t* clone) {
+  arena_t* parent = clone->parent;
+  if (clone->prev_clone != NULL) {
+    clone->prev_clone->next_clone = clone->next_clone;
+  } else {
+    parent->clones = clone->next_clone;
+  }
+  if (clone->next_clone != NULL) {
+    clone->next_clone->prev_clone = clone->prev_clone;
+  }
+  clone->parent = NULL;
+}
+// Copiază paginile scrise ale unei arene fără memfd propriu (clonă, arenă
+// încărcată sau anonimă) într-un memfd nou și o remapează peste el, ca să
+// poată fi clonată la rândul ei. Costul e proporțional cu datele scrise.
+// Părintele e blocat exclusiv cât timp clona încă vede paginile lui.
+static int flatten(arena_t* arena) {
+  arena_t* parent = arena->parent;
+  if (parent != NULL) {
+    lock_structure(parent, 1);
+  }
+  uint64_t offset;
+  int fd = create_backing(arena, &offset);
+  uint64_t page = 0, start, end;
+  while (fd >= 0 && next_committed_run(arena, &page, &start, &end)) {
+    while (start < end) {
+      ssize_t n =
+          pwrite(fd, arena->data + start, end - start, offset + start);
+      if (n <= 0) {
+        drop_backing(arena, fd, offset);
+        fd = -1;
+        break;
+      }
+      start += n;
+    }
+  }
+  if (fd >= 0 && !map_backing(arena, fd, offset)) {
+    drop_backing(arena, fd, offset);
+    fd = -1;
+  }
+  if (fd >= 0) {
+    arena->backing = fd;
+    arena->backing_offset = offset;
+    arena->mapped = 0;
+    if (parent != NULL) {
+      unlink_clone(arena);
+    }
+    if (arena->private_pages != NULL) {
+      munmap(arena->private_pages, bitmap_size(arena));
+      arena->private_pages = NULL;
+    }
+  }
+  if (parent != NULL) {
+    unlock_structure(parent);
+  }
+  return fd >= 0;
+}
+// Mapează privat memfd-ul părintelui în clonă și copiază bitmap-ul paginilor
+// scrise.
+static vma_status share_data(arena_t* arena, arena_t* clone) {
+  void* data = mmap(NULL, arena->arena_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_NORESERVE, arena->backing,
+                    arena->backing_offset);
+  if (data == MAP_FAILED) {
+    return VMA_NO_MEMORY;
+  }
+  clone->data = data;
+  clone->mapped = 1;
+  clone->committed = map_bitmap(clone);
+  clone->private_pages = map_bitmap(clone);
+  if (clone->committed == NULL || clone->private_pages == NULL) {
+    return VMA_NO_MEMORY;
+  }
+  memcpy(clone->committed, arena->committed, bitmap_size(arena));
+  clone->committed_pages = arena->committed_pages;
+  clone->parent = arena;
+  clone->prev_clone = NULL;
+  clone->next_clone = arena->clones;
+  if (arena->clones != NULL) {
+    arena->clones->prev_clone = clone;
+  }
+  arena->clones = clone;
+  return VMA_OK;
+}
+vma_status vma_clone(arena_t* arena, arena_t** clone) {
+  lock_structure(arena, 1);
+  // Clona împarte cu arena doar paginile aflate în memfd.
+  unpack_all(arena, 1);
+  vma_status status = VMA_OK;
+  arena_t* copy = NULL;
+  if (arena->data != NULL && arena->backing < 0 && !flatten(arena)) {
+    status = VMA_NO_MEMORY;
+  }
+  if (status == VMA_OK) {
+    copy = alloc_arena_in(arena->domain, arena->arena_size);
+    if (copy == NULL) {
+      status = VMA_NO_MEMORY;
+    }
+  }
+  if (status == VMA_OK && arena->data != NULL) {
+    status = share_data(arena, copy);
+  }
+  for (block_t* block = arena->alloc_list->head;
+       block != NULL && status == VMA_OK; block = block->next) {
+    miniblock_t* miniblock = block->miniblocks.head;
+    for (; miniblock != NULL && status == VMA_OK;
+         miniblock = miniblock->next) {
+      status = restore_miniblock(copy, miniblock->start_address,
+                                 miniblock->size, miniblock->perm);
+    }
+  }
+  unlock_structure(arena);
+  if (status == VMA_OK && arena->pack_after != 0) {
+    status = vma_set_compression(copy, arena->pack_after);
+  }
+  if (status != VMA_OK) {
+    if (copy != NULL) {
+      dealloc_arena(copy);
+    }
+    return status;
+  }
+  copy->next_fit = arena->next_fit;
+  *clone = copy;
+  return VMA_OK;
+}
+// Într-un domeniu, nodurile încă folosite se întorc în cache-urile arenei,
+// de unde pool_destroy le dă înapoi pool-urilor comune.
+static void release_nodes(arena_t* arena) {
+  block_t* block = arena->alloc_list->head;
+  while (block != NULL) {
+    block_t* next = block->next;
+    miniblock_t* miniblock = block->miniblocks.head;
+    while (miniblock != NULL) {
+      miniblock_t* aux = miniblock->next;
+      free_mem_miniblock(arena, miniblock);
+      miniblock = aux;
+    }
+    free_mem_block(arena, block);
+    block = next;
+  }
+  extent_t* extent = arena->free_head;
+  while (extent != NULL) {
+    extent_t* next = extent->next;
+    pool_free(&arena->extent_pool, extent);
+    extent = next;
+  }
+}
+// Nodurile unei arene fără domeniu trăiesc în pool-urile ei, deci sunt
+// eliberate odată cu acestea, fără a parcurge listele.
+void dealloc_arena(arena_t* arena) {
+  if (arena->parent != NULL) {
+    arena_t* parent = arena->parent;
+    lock_structure(parent, 1);
+    unlink_clone(arena);
+    unlock_structure(parent);
+  }
+  // Clonele rămase păstrează memfd-ul prin maparea lor; nimeni nu îl mai
+  // modifică. Într-un domeniu, zona lor din memfd rămâne deci neatinsă.
+  for (arena_t* clone = arena->clones; clone != NULL;
+       clone = clone->next_clone) {
+    clone->parent = NULL;
+  }
+  if (arena->backing >= 0 &&
+      (arena->domain == NULL || arena->clones == NULL)) {
+    drop_backing(arena, arena->backing, arena->backing_offset);
+  }
+  if (arena->domain != NULL) {
+    release_nodes(arena);
+  }
+  if (arena->private_pages != NULL) {
+    munmap(arena->private_pages, bitmap_size(arena));
+  }
+  if (arena->packed != NULL) {
+    unpack_all(arena, 0);
+    munmap(arena->packed, table_size(arena, sizeof(packed_page*)));
+    munmap(arena->touched, table_size(arena, sizeof(uint64_t)));
+  }
+  pool_destroy(&arena->miniblock_pool);
+  pool_destroy(&arena->block_pool);
+  pool_destroy(&arena->extent_pool);
+  if (arena->data != NULL) {
+    munmap(arena->data, arena->arena_size);
+    munmap(arena->committed, bitmap_size(arena));
+  }
+  free(arena->alloc_list);
+#ifdef VMA_THREADS
+  pthread_rwlock_destroy(&arena->lock);
+  for (int i = 0; i < VMA_SHARDS; i++) {
+    pthread_rwlock_destroy(&arena->shards[i]);
+  }
+#endif
+  if (arena->domain != NULL) {
+    release_domain(arena->domain);
+  }
+  free(arena);
+}
@@ -0,0 +1,372 @@
+#ifndef VMA_H_
+#define VMA_H_
+#include <stddef.h>
+#include <stdint.h>
+#ifdef VMA_THREADS
+#include <pthread.h>
+#endif
+
+// Permisiunile unui miniblock, combinabile ca la mprotect(2). Nu sunt
+// valorile PROT_* din <sys/mman.h>: bitii urmează ordinea din "RWX".
+#define VMA_PROT_NONE 0
+#define VMA_PROT_EXEC 1
+#define VMA_PROT_WRITE 2
+#define VMA_PROT_READ 4
+
+// Datele unui miniblock sunt la data + start_address, deci nodul nu ține un
+// pointer spre ele; prioritatea și permisiunile împart un singur cuvânt.
+typedef struct miniblock_t {
+  uint64_t start_address;  // adresa de început a zonei, un indice din arenă
+  size_t size;             // size-ul miniblock-ului
+  struct miniblock_t *next, *prev;
+  struct miniblock_t *left, *right;  // fiii din treap-ul blocului
+  unsigned int count;  // numărul de miniblock-uri din subarborele nodului
+  unsigned int priority : 24;  // prioritatea nodului în treap
+  unsigned int perm : 4;       // permisiunile asociate zonei, by default RW-
+  unsigned int perm_all : 4;   // AND-ul permisiunilor din subarborele nodului
+} miniblock_t;
+typedef struct miniblock_list {
+  miniblock_t* head;
+  miniblock_t* last;
+  miniblock_t* root;  // treap ordonat după start_address, pentru căutare și
+                      // split în O(log k)
+  unsigned int size;
+} miniblock_list;
+typedef struct block_t {
+  uint64_t start_address;  // adresa de început a zonei, un indice din arenă
+  size_t size;  // dimensiunea totală a zonei, suma size-urilor miniblock-urilor
+  miniblock_list miniblocks;  // miniblock-urile adiacente, în același nod
+  struct block_t *next, *prev;
+  struct block_t *left, *right;  // fiii din arborele de adrese (treap)
+  uint32_t priority;             // prioritatea nodului în treap
+} block_t;
+typedef struct {
+  block_t* head;
+  block_t* last;
+  block_t* root;  // rădăcina indexului ordonat după start_address
+  unsigned int data_size;
+  unsigned int size;
+} list_t;
+
+// Zonă liberă maximală din arenă. Nodul face parte din două treap-uri: cel
+// ordonat după adresă, augmentat cu max_size, și cel al bucket-ului de
+// dimensiune, ordonat după (size, start_address).
+typedef struct extent_t {
+  uint64_t start_address, size;
+  uint64_t max_size;  // cea mai mare zonă din subarborele de adrese
+  struct extent_t *left, *right;            // fiii din arborele de adrese
+  struct extent_t *size_left, *size_right;  // fiii din arborele bucket-ului
+  struct extent_t *prev, *next;             // vecinele, în ordinea adreselor
+  uint32_t priority;
+} extent_t;
+#define VMA_SIZE_BUCKETS 64  // bucket-ul i: zone cu size în [2^i, 2^(i+1))
+
+typedef struct pool_chunk {
+  struct pool_chunk* next;
+} pool_chunk;
+typedef struct pool_t {
+  size_t node_size;    // dimensiunea unui nod, rotunjită la aliniere
+  void* free_list;     // nodurile libere, legate prin primul cuvânt
+  unsigned int free_count;
+  pool_chunk* chunks;  // zonele alocate cu malloc, eliberate toate odată
+  // Dacă nu e NULL, pool-ul e doar un cache al unei arene: ia noduri din
+  // pool-ul comun în loturi și îi dă înapoi surplusul.
+  struct pool_t* shared;
+#ifdef VMA_THREADS
+  pthread_mutex_t lock;  // folosit doar de pool-urile comune
+#endif
+} pool_t;
+
+// Resursele împărțite de mai multe arene: pool-urile de noduri și un singur
+// memfd, în care datele fiecărei arene ocupă o zonă proprie. O arenă mică
+// nu mai rezervă astfel blocuri întregi de noduri și nici un descriptor.
+typedef struct vma_domain {
+  pool_t block_pool, miniblock_pool, extent_pool;
+  int backing;            // memfd-ul comun, creat la prima arenă cu date
+  uint64_t backing_size;  // sfârșitul ultimei zone rezervate în memfd
+  unsigned int users;     // arenele din domeniu, plus creatorul lui
+#ifdef VMA_THREADS
+  pthread_mutex_t lock;  // backing și users
+#endif
+} vma_domain;
+
+// Instrumentarea (make STATS=0 o elimină complet): contoare și histograme de
+// latență cu bucket-uri logaritmice, bucket-ul i numărând duratele din
+// [2^i, 2^(i+1)) ns.
+#define VMA_HIST_BUCKETS 40
+typedef struct vma_hist {
+  uint64_t count, total_ns;
+  uint64_t buckets[VMA_HIST_BUCKETS];
+} vma_hist;
+// Comenzile, măsurate de apelant de la parsare până la afișare.
+typedef enum vma_command {
+  VMA_CMD_ALLOC_BLOCK,
+  VMA_CMD_FREE_BLOCK,
+  VMA_CMD_WRITE,
+  VMA_CMD_READ,
+  VMA_CMD_PMAP,
+  VMA_CMD_READV,
+  VMA_CMD_WRITEV,
+  VMA_CMD_COMPACT,
+  VMA_CMD_MEMSET,
+  VMA_CMD_MEMMOVE,
+  VMA_CMD_FIND,
+  VMA_COMMANDS
+} vma_command;
+// Fazele interne ale operațiilor; VMA_PHASE_OUTPUT e măsurată de apelant.
+typedef enum vma_phase {
+  VMA_PHASE_CHECK_MEMORY,
+  VMA_PHASE_CHECK_NEIGHBORS,
+  VMA_PHASE_SPLIT_BLOCK,
+  VMA_PHASE_COPY,
+  VMA_PHASE_PACK,     // comprimarea unei pagini reci
+  VMA_PHASE_INFLATE,  // decomprimarea ei la următorul acces
+  VMA_PHASE_OUTPUT,
+  VMA_PHASES
+} vma_phase;
+typedef struct vma_stats {
+  uint64_t nodes_visited;  // noduri parcurse în arborii de căutare
+  uint64_t merges;         // blocuri lipite de un miniblock nou
+  uint64_t splits;         // blocuri rupte în două de FREE_BLOCK
+  uint64_t bytes_copied;   // octeți transferați de READ/WRITE
+  // Căutările rezolvate lângă cursor, respectiv prin arbori.
+  uint64_t block_hits, block_misses;
+  uint64_t miniblock_hits, miniblock_misses;
+  vma_hist commands[VMA_COMMANDS];
+  vma_hist phases[VMA_PHASES];
+} vma_stats;
+
+#ifdef VMA_STATS
+#ifdef VMA_THREADS
+// READ/WRITE concurente actualizează contoarele sub lock-ul partajat.
+#define VMA_STAT_ADD(arena, field, n) \
+  __atomic_fetch_add(&(arena)->stats.field, (n), __ATOMIC_RELAXED)
+#else
+#define VMA_STAT_ADD(arena, field, n) ((arena)->stats.field += (n))
+#endif
+#define VMA_TIMER_START(name) uint64_t name = vma_now_ns()
+#define VMA_TIMER_STOP(arena, hist, name) \
+  vma_hist_add(&(arena)->stats.hist, vma_now_ns() - (name))
+#else
+#define VMA_STAT_ADD(arena, field, n) ((void)(arena))
+#define VMA_TIMER_START(name) ((void)0)
+#define VMA_TIMER_STOP(arena, hist, name) ((void)(arena))
+#endif
+
+// Cu VMA_THREADS, arena poate fi folosită din mai multe thread-uri. Structura
+// (blocuri, miniblock-uri, zone libere) e protejată de lock: ALLOC/FREE îl
+// iau exclusiv, READ/WRITE partajat. Datele sunt împărțite în fâșii de
+// 2^VMA_SHARD_SHIFT octeți, fâșia i fiind păzită de shards[i % VMA_SHARDS],
+// așa că transferurile pe zone disjuncte rulează în paralel.
+#define VMA_SHARDS 64
+#define VMA_SHARD_SHIFT 16
+
+typedef struct arena_t {
+  uint64_t arena_size, free_size;
+  list_t* alloc_list;
+  int no_miniblocks;
+  int8_t* data;  // zona continuă a arenei, rezervată la primul ALLOC_BLOCK
+  // Bitul p e setat dacă pagina p a fost scrisă; paginile nesetate se citesc
+  // ca zerouri fără a fi atinse, iar cele eliberate sunt date înapoi
+  // sistemului. Bitmap-ul e rezervat la fel de leneș ca datele.
+  uint64_t* committed;
+  uint64_t committed_pages;
+  unsigned int page_shift;
+  int mapped;   // datele sunt o mapare privată a unui fișier (snapshot, clonă)
+  int backing;  // memfd-ul datelor, mapat partajat, sau -1
+  uint64_t backing_offset;  // începutul datelor în memfd
+  vma_domain* domain;       // NULL dacă arena are pool-uri și memfd proprii
+  // Clonele mapează privat memfd-ul părintelui. Înainte ca părintele să
+  // modifice o pagină, clonele care încă o văd de acolo primesc o copie a ei,
+  // marcată în private_pages.
+  struct arena_t* parent;
+  struct arena_t *clones, *next_clone, *prev_clone;
+  uint64_t* private_pages;
+  pool_t block_pool, miniblock_pool, extent_pool;
+  extent_t* free_root;                       // zonele libere, după adresă
+  extent_t* free_head;                       // prima zonă liberă
+  extent_t* free_buckets[VMA_SIZE_BUCKETS];  // aceleași zone, după size
+  uint64_t free_mask;  // bitul i e setat dacă free_buckets[i] nu e gol
+  uint64_t next_fit;   // de unde continuă căutarea pentru VMA_FIT_NEXT
+  // Ultimul bloc și ultimul miniblock găsite; căutările pornesc de lângă
+  // ele, așa că accesele secvențiale nu mai coboară în arbori.
+  block_t* cursor;
+  miniblock_t* miniblock_cursor;
+  uint32_t seed;       // starea generatorului de priorități al treap-urilor
+  // Compresia paginilor reci (vma_set_compression). packed[p] e copia
+  // comprimată a paginii p, a cărei memorie a fost dată înapoi sistemului;
+  // touched[p] e valoarea lui clock la ultimul acces al paginii. Tabelele
+  // sunt rezervate la prima activare.
+  uint64_t pack_after;   // operațiile fără acces după care o pagină e rece
+  uint64_t clock;        // operațiile executate de la activare
+  uint64_t pack_cursor;  // pagina de la care continuă trecerea de compresie
+  struct packed_page** packed;
+  uint64_t* touched;
+  uint64_t packed_pages, packed_bytes;
+  int packing;  // o trecere de compresie e în curs
+#ifdef VMA_THREADS
+  pthread_rwlock_t lock;
+  pthread_rwlock_t shards[VMA_SHARDS];
+#endif
+#ifdef VMA_STATS
+  vma_stats stats;
+#endif
+} arena_t;
+
+// Rezultatul operațiilor pe arenă. Biblioteca nu afișează nimic; mesajele
+// corespunzătoare sunt treaba apelantului.
+typedef enum vma_status {
+  VMA_OK = 0,
+  VMA_TRUNCATED,          // READ/WRITE limitat la sfârșitul blocului
+  VMA_OUTSIDE_ARENA,      // adresa de început e în afara arenei
+  VMA_END_PAST_ARENA,     // zona depășește sfârșitul arenei
+  VMA_ALREADY_ALLOCATED,  // zona se suprapune cu una alocată
+  VMA_INVALID_ADDRESS,    // nu există miniblock/bloc la adresa dată
+  VMA_NO_MEMORY,          // alocarea metadatelor sau a memoriei a eșuat
+  VMA_NO_FIT,             // nicio zonă liberă nu e destul de mare
+  VMA_NO_PERMISSION,      // zona nu are permisiunea cerută
+  VMA_IO_ERROR,           // fișierul snapshot-ului nu a putut fi deschis,
+                          // citit sau scris
+  VMA_BAD_SNAPSHOT        // fișierul nu e un snapshot valid pentru sistem
+} vma_status;
+// Politicile de alegere a zonei pentru alloc_any.
+typedef enum vma_fit {
+  VMA_FIT_FIRST,  // zona liberă cu adresa cea mai mică
+  VMA_FIT_BEST,   // cea mai mică zonă liberă suficient de mare
+  VMA_FIT_NEXT    // prima zonă de după ultima alocare alloc_any
+} vma_fit;
+
+// Un segment al unui READV/WRITEV: size e dimensiunea cerută, iar done și
+// status sunt completate ca *size și rezultatul unui READ/WRITE separat.
+typedef struct vma_segment {
+  uint64_t address, size;
+  uint64_t done;
+  vma_status status;
+} vma_segment;
+#define VMA_SEGMENTS_ON_STACK 64  // peste atâtea, ordinea e alocată cu malloc
+
+// Furnizează cel mult size octeți în dst și întoarce câți a scris; 0 înseamnă
+// că datele s-au terminat.
+typedef size_t (*vma_source_fn)(void* ctx, int8_t* dst, size_t size);
+// Primește, în ordine, zonele continue ale unei citiri.
+typedef void (*vma_sink_fn)(void* ctx, const int8_t* src, size_t size);
+
+// Primește, pentru fiecare bloc mutat de vma_compact, vechea și noua adresă
+// de început; adresele din bloc se translatează cu aceeași diferență.
+typedef void (*vma_relocate_fn)(void* ctx, uint64_t old_address,
+                                uint64_t new_address, uint64_t size);
+// Costul unei compactări. Fragmentarea este 1 - (cea mai mare zonă liberă /
+// memoria liberă totală): 0 când tot spațiul liber e continuu.
+typedef struct vma_compact_report {
+  uint64_t blocks_moved, bytes_moved;
+  uint64_t duration_ns;
+  double fragmentation_before, fragmentation_after;
+} vma_compact_report;
+
+uint64_t vma_now_ns(void);
+void vma_hist_add(vma_hist* hist, uint64_t ns);
+// Limita superioară a bucket-ului în care cade percentila p (0-100).
+uint64_t vma_hist_percentile(const vma_hist* hist, unsigned int p);
+
+arena_t* alloc_arena(const uint64_t size);
+void dealloc_arena(arena_t* arena);
+// Un domeniu gol. Arenele create în el (și clonele lor) îi împart
+// resursele; vma_domain_destroy renunță la el, iar memoria e eliberată
+// odată cu ultima arenă.
+vma_domain* vma_domain_create(void);
+void vma_domain_destroy(vma_domain* domain);
+// Ca alloc_arena, dar în domain; cu NULL, arena are resurse proprii.
+arena_t* alloc_arena_in(vma_domain* domain, const uint64_t size);
+
+vma_status alloc_block(arena_t* arena, const uint64_t address,
+                       const uint64_t size);
+vma_status free_block(arena_t* arena, const uint64_t address);
+// Alege o zonă liberă de cel puțin size octeți după politica dată, o alocă
+// la începutul ei și întoarce adresa în *address. O(log n) în numărul de
+// zone libere.
+vma_status alloc_any(arena_t* arena, const uint64_t size, vma_fit policy,
+                     uint64_t* address);
+
+// Schimbă permisiunile miniblock-ului care începe la address.
+vma_status vma_mprotect(arena_t* arena, const uint64_t address,
+                        const uint8_t perm);
+
+// Verifică dacă address e alocată și limitează *size la sfârșitul blocului,
+// exact ca READ/WRITE, fără a transfera date. Zona rezultată trebuie să aibă
+// toate permisiunile din perm (VMA_PROT_READ pentru READ, VMA_PROT_WRITE
+// pentru WRITE).
+vma_status vma_resolve(arena_t* arena, const uint64_t address, uint64_t* size,
+                       const uint8_t perm);
+// Începutul ultimului miniblock din blocul care conține address.
+vma_status vma_last_miniblock(arena_t* arena, const uint64_t address,
+                              uint64_t* start);
+// La READ/WRITE, *size este dimensiunea cerută la intrare și numărul de
+// octeți transferați la ieșire (mai mic dacă rezultatul e VMA_TRUNCATED).
+vma_status vma_read(arena_t* arena, const uint64_t address, uint64_t* size,
+                    int8_t* buffer);
+vma_status vma_read_to(arena_t* arena, const uint64_t address, uint64_t* size,
+                       vma_sink_fn sink, void* ctx);
+vma_status vma_write(arena_t* arena, const uint64_t address, uint64_t* size,
+                     const int8_t* data);
+vma_status vma_write_from(arena_t* arena, const uint64_t address,
+                          uint64_t* size, vma_source_fn source, void* ctx);
+// Transferuri vectoriale: segmentele sunt verificate în ordinea adreselor,
+// cu o singură trecere prin lista de blocuri, sub un singur lock. Datele
+// circulă în ordinea segmentelor; status-urile tuturor sunt completate
+// înainte de primul apel al lui sink.
+void vma_readv(arena_t* arena, vma_segment* segments, size_t count,
+               vma_sink_fn sink, void* ctx);
+// data conține payload-urile segmentelor alipite, câte size octeți fiecare;
+// octeții de după done ai unui segment sunt ignorați.
+void vma_writev(arena_t* arena, vma_segment* segments, size_t count,
+                const int8_t* data);
+
+// Operații pe zone din arenă, fără ca datele să treacă prin apelant. Zonele
+// sunt verificate și limitate la sfârșitul blocului ca la READ/WRITE; *size
+// devine numărul de octeți prelucrați.
+vma_status vma_memset(arena_t* arena, const uint64_t address, uint64_t* size,
+                      const uint8_t value);
+// Copiază [src, src + *size) la dst, corect și când zonele se suprapun.
+// Sursa trebuie să poată fi citită, destinația scrisă; *size e limitat de
+// ambele blocuri.
+vma_status vma_memmove(arena_t* arena, const uint64_t dst, const uint64_t src,
+                       uint64_t* size);
+// Caută prima apariție a lui pattern în [address, address + *size) și o
+// întoarce în *found, sau VMA_NOT_FOUND.
+#define VMA_NOT_FOUND UINT64_MAX
+vma_status vma_find(arena_t* arena, const uint64_t address, uint64_t* size,
+                    const int8_t* pattern, const uint64_t length,
+                    uint64_t* found);
+
+double vma_fragmentation(arena_t* arena);
+// Octeții ocupați de nodurile blocurilor și ale miniblock-urilor arenei.
+uint64_t vma_metadata_size(arena_t* arena);
+// Comprimă paginile scrise neaccesate de idle_ops operații, pe care le
+// găsește o trecere care avansează câteva pagini la fiecare operație; o
+// pagină comprimată e decomprimată la următorul acces. Paginile care nu se
+// micșorează cu cel puțin o optime rămân necomprimate. idle_ops = 0
+// oprește compresia și decomprimă tot.
+vma_status vma_set_compression(arena_t* arena, uint64_t idle_ops);
+// Mută toate blocurile spre începutul arenei, păstrându-le ordinea, astfel
+// încât memoria liberă să devină o singură zonă. Datele sunt copiate în bloc,
+// iar relocate (dacă nu e NULL) primește harta vechi -> nou.
+void vma_compact(arena_t* arena, vma_relocate_fn relocate, void* ctx,
+                 vma_compact_report* report);
+
+// Scrie arena într-un snapshot, printr-un fișier temporar redenumit la final,
+// așa că un snapshot mapat de o arenă încărcată nu e modificat sub ea.
+// Doar paginile scrise ajung pe disc; restul zonei de date rămâne o gaură.
+vma_status vma_save(arena_t* arena, const char* path);
+// Încarcă un snapshot: datele sunt mapate privat din fișier și citite de pe
+// disc abia la primul acces, deci durata depinde doar de numărul de
+// miniblock-uri. În caz de succes, *arena este noua arenă.
+vma_status vma_load(const char* path, arena_t** arena);
+vma_status vma_load_in(vma_domain* domain, const char* path, arena_t** arena);
+// Creează o copie a arenei care împarte paginile de date cu ea; fiecare
+// parte copiază o pagină abia când o modifică. Metadatele sunt copiate, deci
+// costul e O(metadate). O arenă fără memfd propriu (o clonă, o arenă
+// încărcată) își mută întâi paginile scrise într-unul. Clona face parte din
+// domeniul arenei. O arenă și clonele ei nu trebuie eliberate concurent.
+vma_status vma_clone(arena_t* arena, arena_t** clone);
+
+#endif  // VMA_H_